@@ -0,0 +1,181 @@
+#ifndef MOZAIKA_ASSIGNMENT_H
+#define MOZAIKA_ASSIGNMENT_H
+
+#include <algorithm>
+#include <climits>
+#include <functional>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include "threadpool.h"
+
+/*
+ * Dokładne optymalne przypisanie kafelków do pól siatki z ograniczeniem liczby użyć każdego kafelka.
+ *
+ * Fitness mozaiki jest sumą niezależnych składników pól, więc bez ograniczeń optimum to po prostu najlepszy kafelek
+ * (i odbicie) w każdym polu. Z ograniczeniem "każdy kafelek co najwyżej K razy" jest to zagadnienie transportowe
+ * (przepływ o minimalnym koszcie: pola -> kafelki o przepustowości K), rozwiązywane tu metodą najkrótszych ścieżek
+ * powiększających z potencjałami (uogólnienie algorytmu węgierskiego na kolumny o przepustowości K). Pola dodawane są
+ * po jednym; po każdym kroku przypisanie dotychczasowych pól jest optymalne, więc wynik końcowy jest optymalny.
+ *
+ * Koszt pola i kafelka to strata fitnessu względem ideału przy lepszym z dwóch odbić. Macierz kosztów liczona jest
+ * równolegle; sam algorytm jest sekwencyjny. Dijkstra wybiera kolejny kafelek z kopca, do którego trafiają tylko kafelki
+ * bliższe niż najkrótsza bezpośrednia ścieżka do ujścia, więc jeden krok kosztuje O(N) na każde pole osiągnięte po drodze
+ * (krawędzie pola do wszystkich kafelków) zamiast O(N) na każdy zdjęty kafelek.
+ */
+
+// Wynik: cellTile[c] i cellReflect[c] dla każdego pola c oraz suma fitnessu. costTable ma układ jak w ga.h
+// (((pole * tilesCount + kafelek) * 2 + odbicie)). reuseLimit <= 0 oznacza brak ograniczenia.
+// Zwraca false, gdy kafelków jest za mało, żeby zapełnić wszystkie pola (tilesCount * reuseLimit < cells).
+
+inline bool optimalAssignment(const std::vector<int> &costTable, int cells, int tilesCount, int reuseLimit, ThreadPool &pool,
+		std::vector<int> &cellTile, std::vector<bool> &cellReflect, long long &fitness) {
+	if (reuseLimit <= 0 || reuseLimit > cells) {
+		reuseLimit = cells; // więcej użyć niż pól i tak nie ma sensu
+	}
+	if ((long long)tilesCount * reuseLimit < cells) {
+		return false;
+	}
+
+	// koszt[pole][kafelek] = największy fitness w tablicy - fitness przy lepszym odbiciu (nieujemny, minimalizowany)
+	std::vector<int> cost((size_t)cells * tilesCount);
+	std::vector<unsigned char> reflect((size_t)cells * tilesCount);
+	int maxFitness = *std::max_element(costTable.begin(), costTable.end());
+	pool.parallelFor(cells, [&](int c, int) {
+		for (int t = 0; t < tilesCount; t++) {
+			size_t index = (size_t)c * tilesCount + t;
+			int plain = costTable[index * 2], reflected = costTable[index * 2 + 1];
+			reflect[index] = reflected > plain;
+			cost[index] = maxFitness - std::max(plain, reflected);
+		}
+	});
+
+	cellTile.assign(cells, -1);
+	cellReflect.assign(cells, false);
+
+	if (reuseLimit == cells) { // bez ograniczenia pola są niezależne
+		pool.parallelFor(cells, [&](int c, int) {
+			const int *row = &cost[(size_t)c * tilesCount];
+			cellTile[c] = std::min_element(row, row + tilesCount) - row;
+		});
+	} else {
+		const long long INF = LLONG_MAX / 4;
+		std::vector<long long> cellPotential(cells, 0), tilePotential(tilesCount, 0);
+		long long sinkPotential = 0;
+		std::vector<int> used(tilesCount, 0); // ile razy kafelek jest już użyty
+		std::vector<std::vector<int> > tileCells(tilesCount); // pola, którym przypisano kafelek
+		std::vector<long long> tileReach(tilesCount), cellDist(cells); // tileReach - odległość kafelka + jego potencjał
+		std::vector<int> tilePrev(tilesCount); // pole, z którego najkrócej dochodzi się do kafelka
+		std::vector<std::pair<long long, int> > heap; // (odległość, kafelek); nieaktualne wpisy pomijane są przy zdejmowaniu
+		std::greater<std::pair<long long, int> > later; // odwraca std::*_heap na kopiec minimum
+
+		for (int s = 0; s < cells; s++) {
+			// potencjał nowego pola dobrany tak, żeby zredukowane koszty jego krawędzi były nieujemne
+			const int *row = &cost[(size_t)s * tilesCount];
+			long long p = LLONG_MIN;
+			for (int t = 0; t < tilesCount; t++) {
+				p = std::max(p, tilePotential[t] - row[t]);
+			}
+			cellPotential[s] = p;
+
+			// Ścieżka do ujścia nie jest dłuższa niż bezpośrednia krawędź do kafelka z wolnym miejscem, więc do kopca trafiają
+			// tylko kafelki bliższe niż ona - zwykle kilka zajętych, najlepiej pasujących kafelków zamiast wszystkich N.
+			long long sinkDist = INF;
+			int sinkTile = -1; // ostatni kafelek ścieżki - z wolnym miejscem
+			for (int t = 0; t < tilesCount; t++) {
+				tileReach[t] = row[t] + p;
+				tilePrev[t] = s;
+				if (used[t] < reuseLimit && tileReach[t] - sinkPotential < sinkDist) { // krawędź kafelek -> ujście
+					sinkDist = tileReach[t] - sinkPotential;
+					sinkTile = t;
+				}
+			}
+			heap.clear();
+			for (int t = 0; t < tilesCount; t++) {
+				if (tileReach[t] - tilePotential[t] < sinkDist) {
+					heap.push_back(std::make_pair(tileReach[t] - tilePotential[t], t));
+				}
+			}
+			std::make_heap(heap.begin(), heap.end(), later);
+			std::fill(cellDist.begin(), cellDist.end(), INF); // INF - pole jeszcze nieosiągnięte
+			cellDist[s] = 0;
+
+			// Dijkstra po zredukowanych kosztach; kończy się, gdy najbliższym wierzchołkiem jest ujście. Zdjęty kafelek nie może
+			// już dostać krótszej odległości (zredukowane koszty są nieujemne), więc nie trzeba go oznaczać.
+			while (!heap.empty()) {
+				std::pop_heap(heap.begin(), heap.end(), later);
+				long long dist = heap.back().first;
+				int t = heap.back().second;
+				heap.pop_back();
+				if (dist != tileReach[t] - tilePotential[t]) { // wpis sprzed skrócenia odległości
+					continue;
+				}
+				if (dist >= sinkDist) {
+					break;
+				}
+
+				if (used[t] < reuseLimit && tileReach[t] - sinkPotential < sinkDist) { // krawędź kafelek -> ujście
+					sinkDist = tileReach[t] - sinkPotential;
+					sinkTile = t;
+				}
+
+				for (int i = 0; i < tileCells[t].size(); i++) { // krawędzie wsteczne kafelek -> pola, którym go przypisano (koszt zredukowany 0)
+					int c = tileCells[t][i];
+					if (cellDist[c] < INF) {
+						continue;
+					}
+					cellDist[c] = dist;
+
+					// najdłuższa pętla algorytmu: czyta tylko wiersz kosztów pola i tileReach, a zapisuje rzadko
+					const int *cRow = &cost[(size_t)c * tilesCount];
+					long long base = dist + cellPotential[c];
+					for (int u = 0; u < tilesCount; u++) {
+						long long reach = base + cRow[u];
+						if (reach < tileReach[u]) {
+							tileReach[u] = reach;
+							tilePrev[u] = c;
+							if (reach - tilePotential[u] < sinkDist) { // dalszych kafelków Dijkstra i tak nie zdejmie przed ujściem
+								heap.push_back(std::make_pair(reach - tilePotential[u], u));
+								std::push_heap(heap.begin(), heap.end(), later);
+							}
+						}
+					}
+				}
+			}
+
+			// nowe potencjały: p += min(odległość, odległość ujścia) - zredukowane koszty pozostają nieujemne
+			for (int c = 0; c <= s; c++) {
+				cellPotential[c] += std::min(cellDist[c], sinkDist);
+			}
+			for (int t = 0; t < tilesCount; t++) {
+				tilePotential[t] = std::min(tileReach[t], tilePotential[t] + sinkDist);
+			}
+			sinkPotential += sinkDist;
+
+			// powiększenie wzdłuż ścieżki: pola na ścieżce przechodzą na kolejny kafelek, nowe pole dostaje pierwszy
+			used[sinkTile]++;
+			for (int t = sinkTile; ; ) {
+				int c = tilePrev[t];
+				int old = cellTile[c];
+				cellTile[c] = t;
+				tileCells[t].push_back(c);
+				if (old < 0) {
+					break;
+				}
+				tileCells[old].erase(std::find(tileCells[old].begin(), tileCells[old].end(), c));
+				t = old;
+			}
+		}
+	}
+
+	fitness = 0;
+	for (int c = 0; c < cells; c++) {
+		size_t index = (size_t)c * tilesCount + cellTile[c];
+		cellReflect[c] = reflect[index];
+		fitness += costTable[index * 2 + reflect[index]];
+	}
+	return true;
+}
+
+#endif
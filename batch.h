@@ -0,0 +1,369 @@
+#ifndef MOZAIKA_BATCH_H
+#define MOZAIKA_BATCH_H
+
+#include <cv.h>
+#include <highgui.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <dirent.h>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/*
+ * Tryb wsadowy (bez okienek i pytań): parametry z linii poleceń lub pliku konfiguracyjnego, wiele obrazów wejściowych,
+ * wyniki zapisywane na dysk. Obrazy przechodzą przez trzystopniowy potok - odczyt następnego obrazu, tworzenie mozaiki
+ * i zapis poprzedniego wyniku odbywają się jednocześnie.
+ *
+ * Parametry: --nazwa=wartość, pojedyncze flagi (np. -p) oraz ścieżki obrazów lub katalogów z obrazami.
+ * --config=plik wczytuje dodatkowe parametry z pliku (linie nazwa=wartość, # rozpoczyna komentarz),
+ * --list=plik wczytuje listę obrazów (jedna ścieżka w linii), --output=katalog włącza tryb wsadowy,
+ * --ext=rozszerzenie wybiera format wyników (domyślnie png), --tile=SZEROKOŚĆxWYSOKOŚĆ ustala rozmiar kafelków dla wszystkich
+ * obrazów, dzięki czemu biblioteka kafelków jest wczytywana tylko raz.
+ */
+
+struct options {
+	std::map<std::string, std::string> values;
+	std::vector<std::string> inputs; // ścieżki obrazów lub katalogów, w kolejności podania
+
+	bool has(const std::string &key) const {
+		return values.count(key) > 0;
+	}
+
+	std::string get(const std::string &key, const std::string &defaultValue) const {
+		std::map<std::string, std::string>::const_iterator it = values.find(key);
+		return it == values.end() ? defaultValue : it->second;
+	}
+
+	// Zwraca wartość liczbową parametru albo domyślną, gdy parametru nie podano. Niepoprawna wartość lub wartość spoza
+	// zakresu [min, max] jest błędem - wypisywany jest komunikat, a ok ustawiane na false.
+
+	int getInt(const std::string &key, int defaultValue, int min, int max, bool &ok) const {
+		if (!has(key)) {
+			return defaultValue;
+		}
+
+		std::string text = get(key, "");
+		char *end;
+		long value = std::strtol(text.c_str(), &end, 10);
+		if (text.empty() || *end != '\0' || value < min || value > max) {
+			std::cout << "Parametr --" << key << " musi być liczbą z zakresu [" << min << ", " << max << "]\n";
+			ok = false;
+			return defaultValue;
+		}
+		return value;
+	}
+
+	// Rozmiar w postaci SZEROKOŚĆxWYSOKOŚĆ lub jednej liczby (kwadrat). Zwraca domyślny, gdy parametru nie podano.
+
+	cv::Size getSize(const std::string &key, cv::Size defaultValue, bool &ok) const {
+		if (!has(key)) {
+			return defaultValue;
+		}
+
+		int width = 0, height = 0;
+		char rest;
+		std::string text = get(key, "");
+		int n = sscanf(text.c_str(), "%dx%d%c", &width, &height, &rest);
+		if (n == 1) {
+			height = width;
+		}
+		if ((n != 1 && n != 2) || width <= 0 || height <= 0) {
+			std::cout << "Parametr --" << key << " musi mieć postać SZEROKOŚĆxWYSOKOŚĆ\n";
+			ok = false;
+			return defaultValue;
+		}
+		return cv::Size(width, height);
+	}
+};
+
+// Dopisuje do opcji parametry z pliku konfiguracyjnego. Parametry z linii poleceń mają pierwszeństwo.
+
+inline bool readConfig(const std::string &path, options &opts) {
+	std::ifstream in(path.c_str());
+	if (!in) {
+		std::cout << "Błąd odczytu pliku konfiguracyjnego " << path << "\n";
+		return false;
+	}
+
+	std::string line;
+	while (std::getline(in, line)) {
+		line = line.substr(0, line.find('#'));
+		line.erase(0, line.find_first_not_of(" \t\r"));
+		line.erase(line.find_last_not_of(" \t\r") + 1);
+		if (line.empty()) {
+			continue;
+		}
+
+		size_t eq = line.find('=');
+		std::string key = line.substr(0, eq);
+		if (!opts.has(key)) {
+			opts.values[key] = eq == std::string::npos ? "1" : line.substr(eq + 1);
+		}
+	}
+	return true;
+}
+
+inline bool parseOptions(int argc, char* argv[], options &opts) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg.compare(0, 2, "--") == 0) {
+			size_t eq = arg.find('=');
+			opts.values[arg.substr(2, eq == std::string::npos ? std::string::npos : eq - 2)] = eq == std::string::npos ? "1" : arg.substr(eq + 1);
+		} else if (arg.size() > 1 && arg[0] == '-') {
+			opts.values[arg.substr(1)] = "1";
+		} else {
+			opts.inputs.push_back(arg);
+		}
+	}
+
+	return !opts.has("config") || readConfig(opts.get("config", ""), opts);
+}
+
+inline bool isPicture(const std::string &fn) {
+	std::string ext = fn.substr(fn.find_last_of(".") + 1);
+	std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+	return ext == "jpg" || ext == "jpeg" || ext == "png" || ext == "bmp";
+}
+
+// Zamienia podane ścieżki na listę plików obrazów: katalogi rozwijane są do posortowanej listy obrazów w nich,
+// a obrazy z pliku --list dopisywane na końcu.
+
+inline std::vector<std::string> expandInputs(const options &opts) {
+	std::vector<std::string> paths = opts.inputs, result;
+
+	if (opts.has("list")) {
+		std::ifstream in(opts.get("list", "").c_str());
+		std::string line;
+		while (std::getline(in, line)) {
+			line.erase(line.find_last_not_of(" \t\r") + 1);
+			if (!line.empty()) {
+				paths.push_back(line);
+			}
+		}
+	}
+
+	for (int i = 0; i < paths.size(); i++) {
+		struct stat st;
+		if (stat(paths[i].c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+			std::vector<std::string> files;
+			DIR *dir = opendir(paths[i].c_str());
+			struct dirent *ent;
+			while (dir != NULL && (ent = readdir(dir)) != NULL) {
+				if (isPicture(ent->d_name)) {
+					files.push_back(paths[i] + "/" + ent->d_name);
+				}
+			}
+			if (dir != NULL) {
+				closedir(dir);
+			}
+			std::sort(files.begin(), files.end());
+			result.insert(result.end(), files.begin(), files.end());
+		} else {
+			result.push_back(paths[i]);
+		}
+	}
+	return result;
+}
+
+// Kolejka o ograniczonej pojemności łącząca kolejne etapy potoku. push() czeka, gdy kolejka jest pełna,
+// pop() czeka na element i zwraca false dopiero po close() i opróżnieniu kolejki.
+
+template <typename T>
+class blockingQueue {
+public:
+	explicit blockingQueue(int capacity) : capacity(capacity), closed(false) {}
+
+	void push(const T &item) {
+		std::unique_lock<std::mutex> lock(mutex);
+		notFull.wait(lock, [this] { return items.size() < capacity; });
+		items.push_back(item);
+		notEmpty.notify_one();
+	}
+
+	// Jak push(), ale bez czekania: zwraca false, gdy kolejka jest pełna albo zamknięta.
+
+	bool tryPush(const T &item) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (closed || items.size() >= capacity) {
+			return false;
+		}
+		items.push_back(item);
+		notEmpty.notify_one();
+		return true;
+	}
+
+	int size() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return items.size();
+	}
+
+	bool pop(T &item) {
+		std::unique_lock<std::mutex> lock(mutex);
+		notEmpty.wait(lock, [this] { return !items.empty() || closed; });
+		if (items.empty()) {
+			return false;
+		}
+		item = items.front();
+		items.pop_front();
+		notFull.notify_one();
+		return true;
+	}
+
+	void close() {
+		std::lock_guard<std::mutex> lock(mutex);
+		closed = true;
+		notEmpty.notify_all();
+	}
+
+private:
+	int capacity;
+	bool closed;
+	std::deque<T> items;
+	std::mutex mutex;
+	std::condition_variable notEmpty, notFull;
+};
+
+struct batchItem { // obraz przechodzący przez potok
+	std::string path;
+	cv::Mat picture; // obraz wejściowy, pusty gdy nie udało się go odczytać
+	cv::Mat mosaic; // wynik, pusty gdy nie udało się go utworzyć
+};
+
+// Ścieżka wyniku: katalog wyjściowy + nazwa pliku wejściowego bez rozszerzenia + podane rozszerzenie.
+
+inline std::string outputPath(const std::string &input, const std::string &directory, const std::string &extension) {
+	std::string name = input.substr(input.find_last_of('/') + 1);
+	return directory + "/" + name.substr(0, name.find_last_of('.')) + "." + extension;
+}
+
+// Ścieżka mozaiki w wysokiej rozdzielczości (render.h) obok wyniku: nazwa.large.tif, a nie nazwa.tif, żeby wynik zapisany
+// z --ext=tif nie nadpisał jej małą mozaiką.
+
+inline std::string largeMosaicPath(const std::string &input, const std::string &directory) {
+	return outputPath(input, directory, "large.tif");
+}
+
+// Tworzy katalog razem z brakującymi katalogami nadrzędnymi. Zwraca false (z komunikatem), gdy się nie da albo nie można
+// w nim zapisywać.
+
+inline bool makeDirectory(const std::string &directory) {
+	for (size_t slash = directory.find('/', 1); ; slash = directory.find('/', slash + 1)) {
+		std::string part = directory.substr(0, slash);
+		if (mkdir(part.c_str(), 0755) != 0 && errno != EEXIST) {
+			std::cout << "Nie można utworzyć katalogu " << part << ": " << strerror(errno) << "\n";
+			return false;
+		}
+		if (slash == std::string::npos) {
+			break;
+		}
+	}
+
+	struct stat st;
+	if (stat(directory.c_str(), &st) != 0 || !S_ISDIR(st.st_mode) || access(directory.c_str(), W_OK) != 0) {
+		std::cout << "Nie można zapisywać w katalogu " << directory << "\n";
+		return false;
+	}
+	return true;
+}
+
+// Sprawdza przed rozpoczęciem obliczeń, czy wyniki da się zapisać: tworzy katalog wyjściowy i odrzuca obrazy, których wyniki
+// miałyby tę samą ścieżkę (ta sama nazwa w różnych katalogach albo z różnymi rozszerzeniami), bo jeden nadpisałby drugi.
+
+inline bool checkOutputs(const std::vector<std::string> &inputs, const std::string &directory, const std::string &extension) {
+	std::map<std::string, std::string> owners; // ścieżka wyniku -> obraz wejściowy
+	bool ok = true;
+	for (int i = 0; i < inputs.size(); i++) {
+		std::string path = outputPath(inputs[i], directory, extension);
+		std::map<std::string, std::string>::iterator it = owners.find(path);
+		if (it != owners.end()) {
+			std::cout << "Obrazy " << it->second << " i " << inputs[i] << " miałyby ten sam plik wynikowy " << path << "\n";
+			ok = false;
+		} else {
+			owners[path] = inputs[i];
+		}
+	}
+	return ok && makeDirectory(directory);
+}
+
+// Przetwarza wszystkie obrazy potokiem: wątek odczytu, bieżący wątek (process - tworzenie mozaiki) i wątek zapisu.
+// Zwraca liczbę obrazów, których nie udało się przetworzyć - wszystkich, gdy wyników nie da się zapisać (checkOutputs).
+
+inline int runBatch(const std::vector<std::string> &inputs, const std::string &directory, const std::string &extension,
+		const std::function<cv::Mat(const batchItem &)> &process) {
+	if (!checkOutputs(inputs, directory, extension)) {
+		return inputs.size();
+	}
+
+	blockingQueue<batchItem> decoded(2), encoded(2); // małe kolejki: co najwyżej kilka obrazów naraz w pamięci
+	int failures = 0;
+	std::mutex failuresMutex;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	std::thread reader([&] {
+		for (int i = 0; i < inputs.size(); i++) {
+			batchItem item;
+			item.path = inputs[i];
+			item.picture = cv::imread(inputs[i], CV_LOAD_IMAGE_COLOR);
+			decoded.push(item);
+		}
+		decoded.close();
+	});
+
+	std::thread writer([&] {
+		batchItem item;
+		while (encoded.pop(item)) {
+			std::string path = outputPath(item.path, directory, extension);
+			bool ok = cv::imwrite(path, item.mosaic);
+			std::lock_guard<std::mutex> lock(failuresMutex);
+			if (ok) {
+				std::cout << "Zapisano " << path << "\n";
+			} else {
+				std::cout << "Błąd zapisu " << path << "\n";
+				failures++;
+			}
+		}
+	});
+
+	batchItem item;
+	while (decoded.pop(item)) {
+		if (!item.picture.data) {
+			std::lock_guard<std::mutex> lock(failuresMutex);
+			std::cout << "Błąd odczytu obrazu " << item.path << "\n";
+			failures++;
+			continue;
+		}
+
+		item.mosaic = process(item);
+		item.picture.release(); // obraz wejściowy nie jest już potrzebny
+		if (!item.mosaic.data) {
+			std::lock_guard<std::mutex> lock(failuresMutex);
+			failures++;
+			continue;
+		}
+		encoded.push(item);
+	}
+	encoded.close();
+
+	reader.join();
+	writer.join();
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "Przetworzono " << inputs.size() - failures << "/" << inputs.size() << " obrazów w " << seconds << " s\n";
+	return failures;
+}
+
+#endif
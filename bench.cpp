@@ -0,0 +1,324 @@
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cv.h>
+#include <highgui.h>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <sys/resource.h>
+
+#include "batch.h"
+#include "colorindex.h"
+#include "ga.h"
+#include "greedy.h"
+#include "grid.h"
+#include "sad.h"
+#include "threadpool.h"
+#include "tilecopy.h"
+#include "tiles.h"
+
+/*
+ * Testy wydajności funkcji tworzących mozaikę - do porównywania wersji programu przed i po zmianach.
+ * Wszystkie dane losowe tworzone są ze stałych ziaren, więc każde uruchomienie mierzy dokładnie tę samą pracę.
+ * Oprócz danych syntetycznych używane są dołączone pliki rocks.jpg, rocks_big.jpg i katalog pictures (pomijane, gdy ich brak).
+ *
+ * ./bench [--filter=tekst] [--time=ms] [--threads=N] [--grid=KOLUMNYxWIERSZE] [--json=plik]
+ * ./bench --selftest
+ *   --filter  uruchamia tylko testy, których nazwa zawiera podany tekst
+ *   --time    minimalny czas pomiaru jednego testu (domyślnie 500 ms)
+ *   --grid    wymiary siatki mozaiki w testach algorytmu genetycznego (domyślnie 30x30)
+ *   --json    zapisuje wyniki w formacie JSON do pliku (domyślnie wypisuje je na końcu na standardowe wyjście)
+ *   --selftest zamiast pomiarów sprawdza, czy wersje SIMD i wyspecjalizowane liczą dokładnie to samo co sadScalar (sadSelfTest)
+ */
+
+struct benchResult {
+	std::string name;
+	std::string unit; // co jest jedną operacją
+	long long iterations;
+	double nsPerOp;
+	double pixelsPerOp; // 0, gdy test nie przetwarza pikseli
+	long peakRssKb; // szczytowe zużycie pamięci procesu po teście
+};
+
+std::vector<benchResult> results;
+std::string FILTER;
+double MIN_SECONDS;
+
+long peakRss() {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss; // w kilobajtach
+}
+
+// Wywołuje f tyle razy, żeby pomiar trwał co najmniej MIN_SECONDS (liczba powtórzeń podwajana), i zapisuje czas jednego wywołania.
+
+void measure(const std::string &name, const std::string &unit, double pixelsPerOp, const std::function<void()> &f) {
+	if (name.find(FILTER) == std::string::npos) {
+		return;
+	}
+
+	f(); // rozgrzewka: pamięć podręczna procesora, leniwa inicjalizacja
+
+	long long iterations = 1;
+	double seconds;
+	while (true) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (long long i = 0; i < iterations; i++) {
+			f();
+		}
+		seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (seconds >= MIN_SECONDS || iterations >= (1LL << 40)) {
+			break;
+		}
+		iterations *= 2;
+	}
+
+	benchResult r;
+	r.name = name;
+	r.unit = unit;
+	r.iterations = iterations;
+	r.nsPerOp = seconds * 1e9 / iterations;
+	r.pixelsPerOp = pixelsPerOp;
+	r.peakRssKb = peakRss();
+	results.push_back(r);
+
+	std::cout << name << ": " << r.nsPerOp << " ns/" << unit << ", " << 1e9 / r.nsPerOp << " " << unit << "/s";
+	if (pixelsPerOp > 0) {
+		std::cout << ", " << pixelsPerOp * 1e9 / r.nsPerOp / 1e6 << " Mpx/s";
+	}
+	std::cout << ", szczytowa pamięć " << r.peakRssKb / 1024 << " MB\n";
+}
+
+cv::Mat randomPicture(int rows, int cols, std::mt19937 &rng) {
+	cv::Mat m(rows, cols, CV_8UC3);
+	for (int i = 0; i < rows; i++) {
+		unsigned char *row = m.ptr(i);
+		for (int j = 0; j < cols * 3; j++) {
+			row[j] = (i + j / 3 + rng() % 64) & 0xff; // gradient z szumem, żeby obraz nie był czystym szumem
+		}
+	}
+	return m;
+}
+
+std::string jsonString(const std::string &s) {
+	std::string out = "\"";
+	for (int i = 0; i < s.size(); i++) {
+		if (s[i] == '"' || s[i] == '\\') {
+			out += '\\';
+		}
+		out += s[i];
+	}
+	return out + "\"";
+}
+
+void writeJson(std::ostream &out, int threads) {
+	out << "{\n  \"threads\": " << threads << ",\n  \"peak_rss_kb\": " << peakRss() << ",\n  \"benchmarks\": [\n";
+	for (int i = 0; i < results.size(); i++) {
+		const benchResult &r = results[i];
+		out << "    {\"name\": " << jsonString(r.name) << ", \"unit\": " << jsonString(r.unit) << ", \"iterations\": " << r.iterations
+				<< ", \"ns_per_op\": " << r.nsPerOp << ", \"ops_per_s\": " << 1e9 / r.nsPerOp
+				<< ", \"pixels_per_s\": " << (r.pixelsPerOp > 0 ? r.pixelsPerOp * 1e9 / r.nsPerOp : 0)
+				<< ", \"peak_rss_kb\": " << r.peakRssKb << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	out << "  ]\n}\n";
+}
+
+int main(int argc, char* argv[]) {
+	options opts;
+	if (!parseOptions(argc, argv, opts)) {
+		return EXIT_FAILURE;
+	}
+
+	if (opts.has("selftest")) {
+		bool ok = sadSelfTest();
+		std::cout << (ok ? "Test SAD: wszystkie wersje zgodne z wersją skalarną\n" : "Test SAD: wyniki niektórych wersji różnią się od wersji skalarnej\n");
+		return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	bool valid = true;
+	FILTER = opts.get("filter", "");
+	MIN_SECONDS = opts.getInt("time", 500, 1, 3600000, valid) / 1000.0;
+	int threads = opts.getInt("threads", 0, 0, 4096, valid);
+	cv::Size grid = opts.getSize("grid", cv::Size(TILES_X, TILES_Y), valid);
+	TILES_X = grid.width;
+	TILES_Y = grid.height;
+	if (!valid) {
+		return EXIT_FAILURE;
+	}
+
+	ThreadPool pool(threads);
+	std::mt19937 rng(1);
+
+	// --- SAD i funkcja przystosowania ---
+
+	cv::Mat pictureA = randomPicture(1000, 1000, rng), pictureB = randomPicture(1000, 1000, rng);
+	double megapixel = 1000.0 * 1000.0;
+
+	measure("sad/scalar/1MP", "op", megapixel, [&] {
+		volatile unsigned long long sink = sadScalar(pictureA.ptr(0), pictureB.ptr(0), (size_t)megapixel * 3);
+		(void)sink;
+	});
+	measure("sad/dispatch/1MP", "op", megapixel, [&] {
+		volatile unsigned long long sink = sadBytes(pictureA.ptr(0), pictureB.ptr(0), (size_t)megapixel * 3);
+		(void)sink;
+	});
+	measure("calculateFitness/synthetic/1MP", "op", megapixel, [&] {
+		volatile long long sink = calculateFitness(pictureA, pictureB);
+		(void)sink;
+	});
+
+	const char *bundled[] = {"rocks.jpg", "rocks_big.jpg"};
+	for (int i = 0; i < 2; i++) {
+		cv::Mat picture = cv::imread(bundled[i], CV_LOAD_IMAGE_COLOR), reflected;
+		if (!picture.data) {
+			continue;
+		}
+		cv::flip(picture, reflected, 1);
+		measure(std::string("calculateFitness/") + bundled[i], "op", (double)picture.total(), [&] {
+			volatile long long sink = calculateFitness(picture, reflected);
+			(void)sink;
+		});
+	}
+
+	// --- kafelek z obszarem obrazu: wersje wyspecjalizowane dla szerokości kafelka i ogólne ---
+
+	const int kernelWidths[] = {8, 16, 20, 32};
+	for (int w = 0; w < 4; w++) {
+		int width = kernelWidths[w];
+		cv::Mat tile = randomPicture(width, width, rng), place;
+		cv::Mat cell = pictureA(cv::Rect(3, 5, width, width)); // obszar większego obrazu - wiersze nieciągłe jak w buildCostTable
+		std::string size = std::to_string(width) + "x" + std::to_string(width);
+		sadTileFunction fixed = sadTileFor(width);
+		measure("sadTile/generic/" + size, "op", width * width, [&] {
+			volatile unsigned long long sink = sadTileGeneric(cell, tile);
+			(void)sink;
+		});
+		measure("sadTile/fixed/" + size, "op", width * width, [&] {
+			volatile unsigned long long sink = fixed(cell, tile);
+			(void)sink;
+		});
+
+		place = pictureB(cv::Rect(3, 5, width, width));
+		copyTileFunction copy = copyTileFor(width);
+		measure("copyTile/generic/reflect/" + size, "op", width * width, [&] {
+			copyTileGeneric(tile, place, true);
+		});
+		measure("copyTile/fixed/reflect/" + size, "op", width * width, [&] {
+			copy(tile, place, true);
+		});
+	}
+
+	// --- algorytm genetyczny na danych syntetycznych: 500 kafelków 20x20, obraz TILES_X*20 x TILES_Y*20 ---
+
+	cv::Size tileSize(20, 20);
+	std::vector<cv::Mat> tiles;
+	for (int i = 0; i < 500; i++) {
+		tiles.push_back(randomPicture(tileSize.height, tileSize.width, rng));
+	}
+	cv::Mat target = randomPicture(tileSize.height * TILES_Y, tileSize.width * TILES_X, rng);
+	cv::Mat mosaic(target.rows, target.cols, CV_8UC3);
+
+	int position = 0;
+	measure("putTileOnMosaic/20x20", "op", tileSize.area(), [&] {
+		putTileOnMosaic(mosaic, tiles[position % tiles.size()], position % (TILES_X * TILES_Y), position & 1);
+		position++;
+	});
+
+	std::vector<int> costTable; // potrzebna dalszym testom także wtedy, gdy sam test buildCostTable jest pominięty
+	buildCostTable(costTable, target, tiles, pool);
+	measure("buildCostTable/500x" + std::to_string(TILES_X * TILES_Y), "op", 2.0 * tiles.size() * target.total(), [&] {
+		std::vector<int> table;
+		buildCostTable(table, target, tiles, pool);
+	});
+
+	POP_SIZE = 300;
+	TOURNAMENT_SIZE = POP_SIZE / 10;
+	PROB_CROSSING = 95;
+	PROB_MUTATION = 2;
+
+	std::vector<gaWorker> workers;
+	initWorkers(workers, pool.size(), 1);
+
+	population specimens, offspring;
+	initPopulation(specimens, costTable, tiles.size(), workers[0].rng);
+	offspring.resize(specimens.size(), specimens.genes());
+
+	measure("tournament/pop300", "op", 0, [&] {
+		volatile int sink = tournament(specimens, workers[0]);
+		(void)sink;
+	});
+	measure("reproduce/pop300", "op", 0, [&] {
+		reproduce(specimens, offspring, 0, tiles, costTable, workers[0]);
+	});
+	measure("nextGeneration/pop300", "generation", 0, [&] {
+		nextGeneration(specimens, offspring, tiles, costTable, pool, workers);
+		specimens.swap(offspring);
+	});
+	measure("renderMosaic/600x600", "op", target.total(), [&] {
+		renderMosaic(specimens, 0, tiles, tileSize);
+	});
+
+	// --- wybór kafelków jak w main2 ---
+
+	std::vector<cv::Scalar> tilesAvgColor;
+	for (int i = 0; i < tiles.size(); i++) {
+		tilesAvgColor.push_back(cv::mean(tiles[i]));
+	}
+	std::vector<int> bestTiles;
+	std::vector<bool> bestReflect(TILES_X * TILES_Y);
+
+	measure("bestTile/linear", "mosaic", target.total(), [&] {
+		bestTiles.resize(TILES_X * TILES_Y);
+		for (int i = 0; i < TILES_X * TILES_Y; i++) {
+			int posX = (i % TILES_X) * tileSize.width;
+			int posY = (i / TILES_X) * tileSize.height;
+			cv::Scalar targetAvgColor = cv::mean(target(cv::Rect(posX, posY, tileSize.width, tileSize.height)));
+			int best = 0, bestDiff = scalarDiff(targetAvgColor, tilesAvgColor[0]);
+			for (int j = 1; j < tiles.size(); j++) {
+				int diff = scalarDiff(targetAvgColor, tilesAvgColor[j]);
+				if (diff < bestDiff) {
+					bestDiff = diff;
+					best = j;
+				}
+			}
+			bestTiles[i] = best;
+		}
+	});
+	measure("bestTile/kdtree", "mosaic", target.total(), [&] {
+		meanColorMatch(target, tilesAvgColor, tileSize, bestTiles, pool);
+	});
+	measure("bestTile/pixel", "mosaic", target.total(), [&] {
+		pixelMatch(target, tiles, tileSize, bestTiles, bestReflect, pool);
+	});
+
+	// --- biblioteka kafelków z katalogu pictures ---
+
+	std::vector<tileSource> sources;
+	if (listTileSources("pictures", sources) && !sources.empty()) {
+		std::vector<uint32_t> files(sources.size());
+		for (int i = 0; i < files.size(); i++) {
+			files[i] = i;
+		}
+		measure("getTiles/decode/pictures", "library", 0, [&] {
+			std::vector<std::vector<cv::Mat> > tilesPerSize;
+			std::vector<uint32_t> sourceIndex;
+			decodeTiles("pictures", sources, files, std::vector<cv::Size>(1, tileSize), tilesPerSize, sourceIndex, pool, false);
+		});
+		tileSet librarySet; // pamięć podręczną buduje w razie potrzeby wywołanie rozgrzewające, przed pomiarem
+		measure("getTiles/cached/pictures", "library", 0, [&] {
+			getTiles(librarySet, tileSize, "pictures", &pool, false); // poprzednie mapowanie zwalniane razem z poprzednim zbiorem kafelków
+		});
+	}
+
+	if (opts.has("json")) {
+		std::ofstream out(opts.get("json", "").c_str());
+		writeJson(out, pool.size());
+	} else {
+		writeJson(std::cout, pool.size());
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,208 @@
+#ifndef MOZAIKA_CHECKPOINT_H
+#define MOZAIKA_CHECKPOINT_H
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <stdint.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "ga.h"
+
+/*
+ * Punkty kontrolne algorytmu genetycznego: plik binarny z genotypami i fitnessem całej populacji, stanem generatorów liczb
+ * losowych i permutacji turniejowych każdego wątku, stanem pętli pokoleń oraz parametrami, od których zależy przebieg.
+ * Wznowienie z punktu kontrolnego daje dokładnie ten sam wynik, co przebieg bez przerwy.
+ *
+ * Plik zapisywany jest najpierw pod niepowtarzalną nazwą tymczasową (mkstemp) i dopiero potem zamieniany (rename), więc
+ * przerwanie programu w trakcie zapisu zostawia poprzedni punkt kontrolny. Suma kontrolna tablic kosztów pilnuje, żeby nie
+ * wznowić ewolucji dla innego obrazu, innych kafelków lub innej siatki, a suma kontrolna całego pliku - żeby nie wczytać
+ * uszkodzonego pliku.
+ *
+ * Układ pliku (liczby w kolejności bajtów komputera): "MOZCKPT1" | uint32 liczba parametrów | int32 parametry[] |
+ * uint64 suma tablic kosztów | int32 pokolenie, poziom, początek poziomu | int64 ostatni najlepszy fitness |
+ * uint32 liczba wątków | dla każdego: uint32 długość + stan generatora (tekst std::mt19937), uint32 długość + int32 permutacja[] |
+ * uint32 osobniki, geny | dla każdego osobnika: int64 fitness, uint64 bity odbić[], uint16 numery kafelków[] | uint64 suma pliku
+ */
+
+struct evolutionState { // stan pętli pokoleń - wszystko, czego poza populacją i wątkami potrzeba do wznowienia
+	int generation; // numer następnego tworzonego pokolenia
+	int level; // bieżący poziom rozdzielczości
+	int levelStart; // pierwsze pokolenie na tym poziomie
+	long long lastBestFitness;
+};
+
+// Suma kontrolna FNV-1a.
+
+inline uint64_t checksum(const void *data, size_t length, uint64_t hash = 14695981039346656037ULL) {
+	const unsigned char *bytes = (const unsigned char *)data;
+	for (size_t i = 0; i < length; i++) {
+		hash = (hash ^ bytes[i]) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+inline uint64_t costTablesChecksum(std::vector<std::vector<int> > &costTables) {
+	uint64_t hash = checksum(NULL, 0);
+	for (int i = 0; i < costTables.size(); i++) {
+		uint64_t size = costTables[i].size();
+		hash = checksum(&size, sizeof(size), hash);
+		hash = checksum(costTables[i].data(), costTables[i].size() * sizeof(int), hash);
+	}
+	return hash;
+}
+
+// Zapisuje punkt kontrolny. parameters - parametry, które przy wznowieniu muszą być takie same.
+
+inline bool saveCheckpoint(const std::string &path, const std::vector<int> &parameters, uint64_t tablesChecksum, const evolutionState &state,
+		std::vector<gaWorker> &workers, population &specimens) {
+	std::string data("MOZCKPT1", 8);
+	auto put = [&](const void *value, size_t length) {
+		data.append((const char *)value, length);
+	};
+	auto putInt = [&](int32_t value) {
+		put(&value, 4);
+	};
+
+	putInt(parameters.size());
+	for (int i = 0; i < parameters.size(); i++) {
+		putInt(parameters[i]);
+	}
+	put(&tablesChecksum, 8);
+	putInt(state.generation);
+	putInt(state.level);
+	putInt(state.levelStart);
+	put(&state.lastBestFitness, 8);
+
+	putInt(workers.size());
+	for (int w = 0; w < workers.size(); w++) {
+		std::ostringstream rng;
+		rng << workers[w].rng;
+		putInt(rng.str().size());
+		data += rng.str();
+		putInt(workers[w].sample.size());
+		put(workers[w].sample.data(), workers[w].sample.size() * 4);
+	}
+
+	int words = (specimens.genes() + 63) / 64;
+	putInt(specimens.size());
+	putInt(specimens.genes());
+	for (int s = 0; s < specimens.size(); s++) {
+		put(&specimens.fitness(s), 8);
+		put(specimens.reflectBits(s), words * 8);
+		put(specimens.tiles(s), specimens.genes() * sizeof(uint16_t));
+	}
+	uint64_t sum = checksum(data.data(), data.size());
+	put(&sum, 8);
+
+	std::vector<char> tempName(path.begin(), path.end()); // nazwa niepowtarzalna - kilka przebiegów może zapisywać ten sam punkt
+	const char suffix[] = ".XXXXXX";
+	tempName.insert(tempName.end(), suffix, suffix + sizeof(suffix)); // razem z kończącym zerem
+	int fd = mkstemp(tempName.data());
+	if (fd < 0) {
+		std::cout << "Błąd zapisu punktu kontrolnego " << path << "\n";
+		return false;
+	}
+	fchmod(fd, 0644); // mkstemp tworzy plik tylko dla właściciela
+	close(fd);
+	std::string temporary(tempName.data());
+
+	std::ofstream out(temporary.c_str(), std::ios::binary | std::ios::trunc);
+	out.write(data.data(), data.size());
+	out.close();
+	if (!out || rename(temporary.c_str(), path.c_str()) != 0) {
+		unlink(temporary.c_str());
+		std::cout << "Błąd zapisu punktu kontrolnego " << path << "\n";
+		return false;
+	}
+	return true;
+}
+
+// Wczytuje punkt kontrolny zapisany przez saveCheckpoint(). Zwraca false (z komunikatem), gdy pliku nie da się odczytać, jest
+// uszkodzony albo pochodzi z innych parametrów lub tablic kosztów - wtedy populacja i wątki mogą być zmienione.
+
+inline bool loadCheckpoint(const std::string &path, const std::vector<int> &parameters, uint64_t tablesChecksum, evolutionState &state,
+		std::vector<gaWorker> &workers, population &specimens) {
+	std::ifstream in(path.c_str(), std::ios::binary);
+	std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	if (!in.good() && !in.eof()) {
+		std::cout << "Błąd odczytu punktu kontrolnego " << path << "\n";
+		return false;
+	}
+
+	uint64_t sum = 0;
+	if (data.size() < 16 || data.compare(0, 8, "MOZCKPT1") != 0
+			|| (memcpy(&sum, data.data() + data.size() - 8, 8), sum != checksum(data.data(), data.size() - 8))) {
+		std::cout << "Plik " << path << " nie jest poprawnym punktem kontrolnym\n";
+		return false;
+	}
+
+	size_t position = 8, end = data.size() - 8;
+	bool ok = true;
+	auto get = [&](void *value, size_t length) {
+		ok = ok && length <= end - position;
+		if (ok) {
+			memcpy(value, data.data() + position, length);
+			position += length;
+		}
+	};
+	auto getInt = [&]() {
+		int32_t value = 0;
+		get(&value, 4);
+		return value;
+	};
+
+	std::vector<int> saved(std::max(0, getInt()));
+	for (int i = 0; ok && i < saved.size(); i++) {
+		saved[i] = getInt();
+	}
+	uint64_t savedChecksum = 0;
+	get(&savedChecksum, 8);
+	if (ok && (saved != parameters || savedChecksum != tablesChecksum)) {
+		std::cout << "Punkt kontrolny " << path << " pochodzi z innego obrazu, innych kafelków albo innych parametrów "
+				<< "(siatka, populacja, turniej, krzyżowanie, mutacja, wątki, poziomy rozdzielczości)\n";
+		return false;
+	}
+
+	state.generation = getInt();
+	state.level = getInt();
+	state.levelStart = getInt();
+	get(&state.lastBestFitness, 8);
+
+	ok = ok && getInt() == workers.size();
+	for (int w = 0; ok && w < workers.size(); w++) {
+		std::string rng(std::max(0, getInt()), '\0');
+		get(&rng[0], rng.size());
+		std::istringstream rngState(rng);
+		rngState >> workers[w].rng;
+		workers[w].sample.resize(std::max(0, getInt()));
+		get(workers[w].sample.data(), workers[w].sample.size() * 4);
+	}
+
+	int count = getInt(), genes = getInt(), words = (genes + 63) / 64;
+	ok = ok && count == POP_SIZE && genes == TILES_X * TILES_Y;
+	if (ok) {
+		specimens.resize(count, genes);
+	}
+	for (int s = 0; ok && s < count; s++) {
+		get(&specimens.fitness(s), 8);
+		get(specimens.reflectBits(s), words * 8);
+		get(specimens.tiles(s), genes * sizeof(uint16_t));
+	}
+
+	if (!ok || position != end || state.level < 0) {
+		std::cout << "Plik " << path << " nie jest poprawnym punktem kontrolnym\n";
+		return false;
+	}
+	return true;
+}
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef MOZAIKA_COLORINDEX_H
+#define MOZAIKA_COLORINDEX_H
+
+#include <cv.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include "threadpool.h"
+
+/*
+ * Indeks średnich kolorów kafelków (drzewo k-d w przestrzeni BGR) do szukania kafelka najbliższego kolorem danemu obszarowi.
+ * Odległością jest scalarDiff(), czyli dokładnie ta miara, której używa przeszukiwanie liniowe, a remisy rozstrzygane są
+ * na korzyść kafelka o mniejszym indeksie - wyniki są identyczne z przeszukiwaniem liniowym, tylko bez sprawdzania wszystkich kafelków.
+ */
+
+// Oblicza różnicę między scalarami - sumę różnic wartości RGB
+
+inline int scalarDiff(const cv::Scalar &s1, const cv::Scalar &s2) {
+	int diff = 0;
+
+	for (int i = 0; i < 3; i++) {
+		diff += std::abs(s1[i] - s2[i]); // każdy składnik obcinany jest do liczby całkowitej
+	}
+
+	return diff;
+}
+
+class colorIndex {
+public:
+	explicit colorIndex(const std::vector<cv::Scalar> &colors) : colors(colors) {
+		order.resize(colors.size());
+		for (int i = 0; i < order.size(); i++) {
+			order[i] = i;
+		}
+		if (!colors.empty()) {
+			build(0, colors.size());
+		}
+	}
+
+	// Indeks kafelka najbliższego kolorem (najmniejszy scalarDiff, przy remisie najmniejszy indeks).
+
+	int nearest(const cv::Scalar &color) const {
+		std::vector<int> result;
+		nearest(color, 1, result);
+		return result.empty() ? -1 : result[0];
+	}
+
+	// k kafelków najbliższych kolorem, posortowanych rosnąco po (scalarDiff, indeks) - tak jak k pierwszych kafelków
+	// stabilnie posortowanej listy z przeszukiwania liniowego.
+
+	void nearest(const cv::Scalar &color, int k, std::vector<int> &result) const {
+		std::vector<candidate> best; // kopiec: na szczycie najgorszy z dotychczas znalezionych
+		best.reserve(k + 1);
+		if (!nodes.empty() && k > 0) {
+			search(0, color, k, best);
+		}
+
+		std::sort_heap(best.begin(), best.end());
+		result.resize(best.size());
+		for (int i = 0; i < best.size(); i++) {
+			result[i] = best[i].index;
+		}
+	}
+
+	// Najbliższy kafelek dla każdego z podanych kolorów, zapytania wykonywane równolegle.
+
+	void nearestBatch(const std::vector<cv::Scalar> &queries, std::vector<int> &result, ThreadPool &pool) const {
+		result.resize(queries.size());
+		pool.parallelFor(queries.size(), [&](int i, int) {
+			result[i] = nearest(queries[i]);
+		});
+	}
+
+private:
+	struct node { // węzeł drzewa: prostopadłościan otaczający kolory kafelków order[begin..end)
+		double lo[3], hi[3];
+		int left, right; // -1 dla liścia
+		int begin, end;
+	};
+
+	struct candidate {
+		int diff, index;
+		bool operator<(const candidate &o) const {
+			return diff < o.diff || (diff == o.diff && index < o.index);
+		}
+	};
+
+	static const int LEAF_SIZE = 8;
+
+	int build(int begin, int end) {
+		node n;
+		n.begin = begin;
+		n.end = end;
+		n.left = n.right = -1;
+		for (int c = 0; c < 3; c++) {
+			n.lo[c] = n.hi[c] = colors[order[begin]][c];
+			for (int i = begin + 1; i < end; i++) {
+				n.lo[c] = std::min(n.lo[c], colors[order[i]][c]);
+				n.hi[c] = std::max(n.hi[c], colors[order[i]][c]);
+			}
+		}
+
+		int id = nodes.size();
+		nodes.push_back(n);
+
+		if (end - begin > LEAF_SIZE) { // podział w medianie wzdłuż najszerszej składowej koloru
+			int axis = 0;
+			for (int c = 1; c < 3; c++) {
+				if (n.hi[c] - n.lo[c] > n.hi[axis] - n.lo[axis]) {
+					axis = c;
+				}
+			}
+			int middle = (begin + end) / 2;
+			std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end, [&](int a, int b) {
+				return colors[a][axis] < colors[b][axis] || (colors[a][axis] == colors[b][axis] && a < b);
+			});
+
+			int left = build(begin, middle);
+			int right = build(middle, end);
+			nodes[id].left = left;
+			nodes[id].right = right;
+		}
+		return id;
+	}
+
+	// Dolne ograniczenie scalarDiff dla wszystkich kolorów w węźle: składowe są obcinane tak samo jak w scalarDiff,
+	// a obcięcie jest monotoniczne, więc ograniczenie jest dokładne również po obcięciu.
+
+	int lowerBound(const node &n, const cv::Scalar &color) const {
+		int bound = 0;
+		for (int c = 0; c < 3; c++) {
+			double d = color[c] < n.lo[c] ? n.lo[c] - color[c] : (color[c] > n.hi[c] ? color[c] - n.hi[c] : 0);
+			bound += (int)d;
+		}
+		return bound;
+	}
+
+	void search(int id, const cv::Scalar &color, int k, std::vector<candidate> &best) const {
+		const node &n = nodes[id];
+
+		if (n.left < 0) {
+			for (int i = n.begin; i < n.end; i++) {
+				candidate c;
+				c.index = order[i];
+				c.diff = scalarDiff(color, colors[c.index]);
+				if (best.size() < k) {
+					best.push_back(c);
+					std::push_heap(best.begin(), best.end());
+				} else if (c < best.front()) {
+					std::pop_heap(best.begin(), best.end());
+					best.back() = c;
+					std::push_heap(best.begin(), best.end());
+				}
+			}
+			return;
+		}
+
+		int first = n.left, second = n.right;
+		int firstBound = lowerBound(nodes[first], color), secondBound = lowerBound(nodes[second], color);
+		if (secondBound < firstBound) { // najpierw bliższe dziecko, żeby szybciej zawęzić poszukiwania
+			std::swap(first, second);
+			std::swap(firstBound, secondBound);
+		}
+
+		// przy równej odległości węzeł nadal może zawierać kafelek o mniejszym indeksie, więc odrzucane są tylko węzły ostro gorsze
+		if (best.size() < k || firstBound <= best.front().diff) {
+			search(first, color, k, best);
+		}
+		if (best.size() < k || secondBound <= best.front().diff) {
+			search(second, color, k, best);
+		}
+	}
+
+	const std::vector<cv::Scalar> &colors; // indeks nie kopiuje kolorów, wektor musi istnieć dłużej niż indeks
+	std::vector<int> order; // indeksy kafelków uporządkowane tak, że każdy węzeł to ciągły fragment
+	std::vector<node> nodes;
+};
+
+#endif
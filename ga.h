@@ -0,0 +1,421 @@
+#ifndef MOZAIKA_GA_H
+#define MOZAIKA_GA_H
+
+#include <cv.h>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <stdint.h>
+#include <vector>
+
+#include "grid.h"
+#include "sad.h"
+#include "telemetry.h"
+#include "threadpool.h"
+#include "tilecopy.h"
+
+/*
+ * Algorytm genetyczny układający kafelki: populacja, tablica kosztów, selekcja, krzyżowanie i mutacja.
+ * Nagłówek definiuje zmienne globalne z parametrami algorytmu, więc w programie może go dołączać tylko jeden plik .cpp.
+ *
+ * Populacja przechowywana jest w jednym ciągłym bloku pamięci, osobno dla każdej składowej chromosomu (numery kafelków
+ * jako liczby 16-bitowe, odbicia jako bity). Dzieci zapisywane są od razu na swoje miejsce w drugiej populacji, a po każdym
+ * pokoleniu populacje zamieniają się rolami, więc tworzenie kolejnych pokoleń nie przydziela pamięci.
+ */
+
+int POP_SIZE; // liczba osobników w każdej populacji
+
+int PROB_CROSSING; // prawdopodobieństwo krzyżowania
+int PROB_MUTATION; // prawdopodobieństwo mutacji
+
+int TOURNAMENT_SIZE; // rozmiar turnieju
+
+const int MAX_TILES = 65536; // numery kafelków zapisywane są na 16 bitach, więc algorytm korzysta co najwyżej z tylu kafelków
+
+// Populacja osobników - sam genotyp, obraz mozaiki tworzy renderMosaic() tylko dla wyświetlanych osobników.
+// Chromosom osobnika s to genes() numerów kafelków (tiles(s)) i tyle samo bitów odbicia lustrzanego (reflected(s, j)).
+
+class population {
+public:
+	population() : count(0), geneCount(0), words(0) {}
+
+	// Zmienia rozmiar populacji. Zawartość chromosomów jest wtedy nieokreślona; przy tym samym rozmiarze nic nie jest przydzielane.
+
+	void resize(int specimens, int genes) {
+		if (specimens == count && genes == geneCount) {
+			return;
+		}
+		count = specimens;
+		geneCount = genes;
+		words = (genes + 63) / 64;
+		size_t tileWords = ((size_t)specimens * genes * sizeof(uint16_t) + 7) / 8;
+		arena.assign((size_t)specimens * (1 + words) + tileWords, 0); // fitness, bity odbić, numery kafelków
+	}
+
+	void swap(population &other) {
+		arena.swap(other.arena);
+		std::swap(count, other.count);
+		std::swap(geneCount, other.geneCount);
+		std::swap(words, other.words);
+	}
+
+	int size() const {
+		return count;
+	}
+
+	int genes() const {
+		return geneCount;
+	}
+
+	long long &fitness(int s) { // współczynnik przystosowania - jak bardzo kolory są podobne do oryginalnych; czym więcej tym lepiej
+		return *(long long *)&arena[s];
+	}
+
+	uint16_t *tiles(int s) { // numery kafelków na kolejnych polach siatki - pierwsza składowa chromosomu
+		return (uint16_t *)&arena[(size_t)count * (1 + words)] + (size_t)s * geneCount;
+	}
+
+	uint64_t *reflectBits(int s) { // odbicia lustrzane kafelków (1 dla odbicia, 0 dla oryginalnego obrazka) - druga składowa chromosomu
+		return &arena[count + (size_t)s * words];
+	}
+
+	bool reflected(int s, int j) {
+		return (reflectBits(s)[j / 64] >> (j % 64)) & 1;
+	}
+
+	void setReflected(int s, int j, bool value) {
+		uint64_t &word = reflectBits(s)[j / 64];
+		word = (word & ~(1ULL << (j % 64))) | ((uint64_t)value << (j % 64));
+	}
+
+	// Kopiuje geny [from, to) osobnika s z populacji source do osobnika d tej populacji.
+
+	void copyGenes(int d, population &source, int s, int from, int to) {
+		std::memcpy(tiles(d) + from, source.tiles(s) + from, (to - from) * sizeof(uint16_t));
+
+		uint64_t *dst = reflectBits(d), *src = source.reflectBits(s);
+		while (from < to) { // bity kopiowane całymi słowami, z maską na krańcach przedziału
+			int word = from / 64, bit = from % 64, n = std::min(64 - bit, to - from);
+			uint64_t mask = (n == 64 ? ~0ULL : (1ULL << n) - 1) << bit;
+			dst[word] = (dst[word] & ~mask) | (src[word] & mask);
+			from += n;
+		}
+	}
+
+	void copySpecimen(int d, population &source, int s) {
+		copyGenes(d, source, s, 0, geneCount);
+		fitness(d) = source.fitness(s);
+	}
+
+private:
+	std::vector<uint64_t> arena; // fitness wszystkich osobników, potem ich bity odbić, potem numery kafelków
+	int count, geneCount, words; // words - liczba 64-bitowych słów odbić na osobnika
+};
+
+struct gaWorker { // stan wątku tworzącego pokolenie - generator liczb losowych i bufory używane ponownie w każdym pokoleniu
+	std::mt19937 rng;
+	std::vector<int> sample; // permutacja numerów osobników, z której losowani są uczestnicy turnieju
+	std::vector<int> cuts; // miejsca cięć chromosomów
+};
+
+void putTileOnMosaic(cv::Mat &, cv::Mat &, int, bool);
+cv::Mat renderMosaic(population &, int, std::vector<cv::Mat> &, cv::Size);
+int bestSpecimenIndex(population &);
+generationStats populationStats(population &);
+void buildCostTable(std::vector<int> &, cv::Mat, std::vector<cv::Mat> &, ThreadPool &);
+int buildCostPyramid(std::vector<std::vector<int> > &, cv::Mat, std::vector<cv::Mat> &, int, int, ThreadPool &);
+int cellFitness(std::vector<int> &, int, int, bool);
+long long specimenFitness(std::vector<int> &, population &, int);
+void initWorkers(std::vector<gaWorker> &, int, int);
+void initPopulation(population &, std::vector<int> &, int, std::mt19937 &);
+void seedPopulation(population &, std::vector<int> &, int, const std::vector<int> &, int, std::mt19937 &);
+int tournament(population &, gaWorker &);
+void reproduce(population &, population &, int, std::vector<cv::Mat> &, std::vector<int> &, gaWorker &);
+void nextGeneration(population &, population &, std::vector<cv::Mat> &, std::vector<int> &, ThreadPool &, std::vector<gaWorker> &);
+
+// Umieszcza kafelek na matrycy mozaiki. Pozycja liczona jest od lewej do prawej od góry do dołu, max pozycja = TILES_X*TILES_Y.
+
+void putTileOnMosaic(cv::Mat &mosaic, cv::Mat &tile, int position, bool reflect) {
+	int posX = (position % TILES_X) * tile.cols;
+	int posY = (position / TILES_X) * tile.rows;
+
+	cv::Rect roi(posX, posY, tile.cols, tile.rows);
+	cv::Mat tilePlace = mosaic(roi);
+	copyTileFor(tile.cols)(tile, tilePlace, reflect); // kopia od razu z odbiciem lustrzanym, jeśli potrzebne
+}
+
+// Tworzy matrycę mozaiki osobnika s na podstawie jego chromosomu. Wywoływana tylko dla osobników, które są wyświetlane.
+
+cv::Mat renderMosaic(population &specimens, int s, std::vector<cv::Mat> &tiles, cv::Size tileSize) {
+	TELEMETRY_PHASE(PHASE_RENDER);
+	cv::Mat mosaic(tileSize.height * TILES_Y, tileSize.width * TILES_X, CV_8UC3);
+	for (int i = 0; i < specimens.genes(); i++) {
+		putTileOnMosaic(mosaic, tiles.at(specimens.tiles(s)[i]), i, specimens.reflected(s, i));
+	}
+	return mosaic;
+}
+
+// Zwraca indeks osobnika z największym fitnessem.
+
+int bestSpecimenIndex(population &specimens) {
+	int best = 0;
+	for (int i = 1; i < specimens.size(); i++) {
+		if (specimens.fitness(i) > specimens.fitness(best)) {
+			best = i;
+		}
+	}
+	return best;
+}
+
+// Najlepszy, średni i najgorszy fitness populacji oraz jej różnorodność - średni odsetek pól, na których osobniki
+// różnią się od najlepszego (kafelkiem lub odbiciem).
+
+generationStats populationStats(population &specimens) {
+	generationStats stats;
+	int best = bestSpecimenIndex(specimens);
+	long long sum = 0, differences = 0;
+
+	stats.best = stats.worst = specimens.fitness(best);
+	for (int i = 0; i < specimens.size(); i++) {
+		stats.worst = std::min(stats.worst, specimens.fitness(i));
+		sum += specimens.fitness(i);
+		for (int j = 0; j < specimens.genes(); j++) {
+			differences += specimens.tiles(i)[j] != specimens.tiles(best)[j] || specimens.reflected(i, j) != specimens.reflected(best, j);
+		}
+	}
+	stats.mean = (double)sum / specimens.size();
+	stats.diversity = (double)differences / ((double)specimens.size() * specimens.genes());
+	return stats;
+}
+
+// Wylicza tablicę fitnessu dla każdej trójki (kafelek, pole siatki, odbicie). Fitness jest sumą niezależnych składników
+// z poszczególnych pól siatki, więc fitness osobnika to suma TILES_X*TILES_Y wartości z tej tablicy i nie trzeba do tego tworzyć mozaiki.
+// Kafelki przetwarzane są równolegle; każdy wypełnia tylko swoje pozycje tablicy.
+
+void buildCostTable(std::vector<int> &costTable, cv::Mat pictureOryg, std::vector<cv::Mat> &tiles, ThreadPool &pool) {
+	costTable.resize((size_t)TILES_X * TILES_Y * tiles.size() * 2);
+	sadTileFunction sad = sadTileFor(tiles[0].cols); // wersja SAD dla tej szerokości kafelków (sad.h)
+
+	pool.parallelFor(tiles.size(), [&](int t, int) {
+		cv::Mat tileReflected;
+		cv::flip(tiles[t], tileReflected, 1); // odbicie lustrzane kafelka, liczone raz dla wszystkich pól
+
+		for (int j = 0; j < TILES_X * TILES_Y; j++) {
+			int posX = (j % TILES_X) * tiles[t].cols; // to samo położenie co w putTileOnMosaic
+			int posY = (j / TILES_X) * tiles[t].rows;
+			cv::Mat cell = pictureOryg(cv::Rect(posX, posY, tiles[t].cols, tiles[t].rows));
+
+			size_t index = ((size_t)j * tiles.size() + t) * 2;
+			costTable[index] = tileFitness(sad, cell, tiles[t]);
+			costTable[index + 1] = tileFitness(sad, cell, tileReflected);
+		}
+	});
+}
+
+// Wylicza tablice fitnessu dla kolejnych poziomów rozdzielczości: na poziomie l obraz i kafelki są zmniejszone 2^l razy
+// w każdym wymiarze, więc tablica liczy się około 4^l razy szybciej. Tworzone są tylko poziomy od finest do levels - 1
+// (pozostałe tablice zostają puste); poziomy, na których kafelek miałby mniej niż jeden piksel, są pomijane.
+// Zwraca liczbę poziomów, która faktycznie zmieściła się w rozmiarze kafelków.
+
+int buildCostPyramid(std::vector<std::vector<int> > &tables, cv::Mat pictureOryg, std::vector<cv::Mat> &tiles, int levels, int finest, ThreadPool &pool) {
+	cv::Size tileSize = tiles[0].size();
+	while (levels > 1 && ((tileSize.width >> (levels - 1)) < 1 || (tileSize.height >> (levels - 1)) < 1)) {
+		levels--;
+	}
+	finest = std::min(finest, levels - 1);
+
+	tables.assign(levels, std::vector<int>());
+	for (int level = finest; level < levels; level++) {
+		if (level == 0) {
+			buildCostTable(tables[0], pictureOryg, tiles, pool);
+			continue;
+		}
+
+		cv::Size size(tileSize.width >> level, tileSize.height >> level);
+		std::vector<cv::Mat> smallTiles(tiles.size());
+		pool.parallelFor(tiles.size(), [&](int t, int) {
+			cv::resize(tiles[t], smallTiles[t], size, 0, 0, cv::INTER_AREA);
+		});
+		cv::Mat smallPicture;
+		cv::Mat grid = pictureOryg(cv::Rect(0, 0, tileSize.width * TILES_X, tileSize.height * TILES_Y)); // bez resztek obrazu spoza siatki
+		cv::resize(grid, smallPicture, cv::Size(size.width * TILES_X, size.height * TILES_Y), 0, 0, cv::INTER_AREA);
+		buildCostTable(tables[level], smallPicture, smallTiles, pool);
+	}
+	return levels;
+}
+
+// Zwraca fitness kafelka tile (z odbiciem lub bez) umieszczonego na pozycji position.
+
+int cellFitness(std::vector<int> &costTable, int tile, int position, bool reflect) {
+	size_t tilesCount = costTable.size() / (2 * TILES_X * TILES_Y);
+	return costTable[((size_t)position * tilesCount + tile) * 2 + reflect];
+}
+
+// Wylicza fitness osobnika s jako sumę fitnessów jego kafelków z tablicy kosztów.
+
+long long specimenFitness(std::vector<int> &costTable, population &specimens, int s) {
+	long long fitness = 0;
+	for (int i = 0; i < specimens.genes(); i++) {
+		fitness += cellFitness(costTable, specimens.tiles(s)[i], i, specimens.reflected(s, i));
+	}
+	return fitness;
+}
+
+// Tworzy stan count wątków. Każdy ma osobny generator liczb losowych, zależny tylko od ziarna i numeru wątku.
+
+void initWorkers(std::vector<gaWorker> &workers, int count, int seed) {
+	workers.resize(count);
+	for (int i = 0; i < count; i++) {
+		std::seed_seq seq = {seed, i};
+		workers[i].rng.seed(seq);
+		workers[i].sample.clear(); // permutacja zależy od przebiegu losowania, więc przy nowym ziarnie tworzona jest od nowa
+	}
+}
+
+// Tworzy początkową populację z losowymi układami kafelków.
+
+void initPopulation(population &specimens, std::vector<int> &costTable, int tilesCount, std::mt19937 &rng) {
+	specimens.resize(POP_SIZE, TILES_X * TILES_Y); // nadaj rozmiar populacji: ilość osobników i ilość kafelków każdego osobnika
+
+	for (int i = 0; i < POP_SIZE; i++) { // ustaw początkowe osobniki
+		for (int j = 0; j < TILES_X * TILES_Y; j++) { // stwórz kafelki
+			specimens.tiles(i)[j] = rng() % tilesCount; // ustaw losowy kafelek
+			specimens.setReflected(i, j, rng() % 2); // przypisz kafelkowi losową wartość odbicia lustrzanego (true/false)
+		}
+		specimens.fitness(i) = specimenFitness(costTable, specimens, i); // wylicz i zapisz fitness osobnika
+	}
+}
+
+// Zastępuje count pierwszych osobników populacji układem seedTiles (np. wynikiem dopasowania po średnim kolorze) i jego
+// wariantami: osobnik 0 to sam układ, w pozostałych co SEED_VARIATION-te pole (średnio) dostaje losowy kafelek. Odbicie każdego
+// kafelka układu wybierane jest według tablicy kosztów.
+
+void seedPopulation(population &specimens, std::vector<int> &costTable, int tilesCount, const std::vector<int> &seedTiles, int count, std::mt19937 &rng) {
+	const int SEED_VARIATION = 10;
+
+	for (int i = 0; i < std::min(count, specimens.size()); i++) {
+		for (int j = 0; j < specimens.genes(); j++) {
+			int tile = seedTiles[j];
+			if (i > 0 && rng() % SEED_VARIATION == 0) {
+				tile = rng() % tilesCount;
+			}
+			specimens.tiles(i)[j] = tile;
+			specimens.setReflected(i, j, cellFitness(costTable, tile, j, true) > cellFitness(costTable, tile, j, false));
+		}
+		specimens.fitness(i) = specimenFitness(costTable, specimens, i);
+	}
+}
+
+// Wybiera osobnika metodą selekcji turniejowej (losuje kilku osobników z populacji i wybiera najlepszego z nich).
+// Uczestnicy losowani są bez powtórzeń częściowym tasowaniem Fishera-Yatesa permutacji wątku: k losowań, bez przeszukiwania
+// i bez przydzielania pamięci.
+
+int tournament(population &specimens, gaWorker &worker) {
+	TELEMETRY_PHASE(PHASE_TOURNAMENT);
+	std::vector<int> &sample = worker.sample;
+	if (sample.size() != specimens.size()) { // pierwszy turniej wątku lub zmiana rozmiaru populacji
+		sample.resize(specimens.size());
+		for (int i = 0; i < sample.size(); i++) {
+			sample[i] = i;
+		}
+	}
+
+	int size = std::max(1, std::min(TOURNAMENT_SIZE, specimens.size())); // turniej nie może być większy od populacji
+	int bestSpecimen = -1; // najlepszy osobnik wybrany do turnieju - zwyciężca
+
+	for (int i = 0; i < size; i++) { // na pozycję i trafia losowy osobnik spośród jeszcze niewybranych (pozycje i..)
+		int j = i + worker.rng() % (sample.size() - i);
+		std::swap(sample[i], sample[j]);
+		if (bestSpecimen < 0 || specimens.fitness(sample[i]) > specimens.fitness(bestSpecimen)) {
+			bestSpecimen = sample[i];
+		}
+	}
+
+	return bestSpecimen;
+}
+
+// Tworzy dwóch nowych osobników (child i child + 1 w populacji children) z pary rodziców z populacji specimens
+// metodą podwójnej selekcji turniejowej, krzyżowania i mutacji.
+
+void reproduce(population &specimens, population &children, int child, std::vector<cv::Mat> &tiles, std::vector<int> &costTable, gaWorker &worker) {
+	std::mt19937 &rng = worker.rng;
+	int mother = tournament(specimens, worker); // wybierz matkę selekcją turniejową
+	int father;
+
+	do { // wybierz ojca selekcją turniejową, ale innego osobnika niż matka
+		father = tournament(specimens, worker);
+	} while (father == mother);
+
+	int genes = specimens.genes();
+
+	if (rng() % 100 + 1 <= PROB_CROSSING) { // krzyżowanie z zadanym prawdopodobieństwem
+		{ // samo krzyżowanie, bez liczenia fitnessu dzieci
+			TELEMETRY_PHASE(PHASE_CROSSOVER);
+			std::vector<int> &cuts = worker.cuts; // miejsca cięć chromosomów, bufor wątku - pamięć przydzielana tylko raz
+			cuts.clear();
+			for (int i = 0; i < genes / 5; i++) { // wylosuj miejsca cięć - ilość cięć = 1/5 dł. chromosomu
+				cuts.push_back(rng() % genes);
+			}
+			cuts.push_back(genes); // dodaj cięcie na końcu, aby zawsze chromosom dziecka był uzupełniony do końca
+			std::sort(cuts.begin(), cuts.end()); // posortuj listę miejsc cięć
+
+			int last = 0; // miejsce poprzedniego cięcia, czyli odkąd zacząć doklejanie kolejnego fragmentu chromosomu
+			for (int i = 0; i < cuts.size(); i++) { // stwórz chromosomy dzieci krzyżując chromosomy rodziców
+				int parent1 = (i % 2 == 1) ? father : mother; // na zmianę bierz kawałek chromosomu ojca i matki
+				int parent2 = (i % 2 == 1) ? mother : father;
+
+				children.copyGenes(child, specimens, parent1, last, cuts[i]);
+				children.copyGenes(child + 1, specimens, parent2, last, cuts[i]);
+
+				last = cuts[i];
+			}
+		}
+
+		TELEMETRY_PHASE(PHASE_FITNESS);
+		children.fitness(child) = specimenFitness(costTable, children, child);
+		children.fitness(child + 1) = specimenFitness(costTable, children, child + 1);
+	} else { // brak krzyżowania - potomkowie są tacy sami jak rodzice (chyba że wystąpi mutacja)
+		TELEMETRY_PHASE(PHASE_COPY);
+		children.copySpecimen(child, specimens, mother);
+		children.copySpecimen(child + 1, specimens, father);
+	}
+
+	for (int c = child; c < child + 2; c++) { // akcje wykonywane na każdym dziecku
+		if (rng() % 100 + 1 <= PROB_MUTATION) { // mutacja z zadanym prawdopodobieństwem, fitness poprawiany tylko o zmienione pola
+			TELEMETRY_PHASE(PHASE_MUTATION);
+			uint16_t *v = children.tiles(c);
+			long long &fitness = children.fitness(c);
+			for (int i = 0; i < genes / 100; i++) { // zamień 1/100 kafelków na losowe
+				int j = rng() % genes;
+				int tile = rng() % tiles.size();
+				bool r = children.reflected(c, j);
+				fitness += cellFitness(costTable, tile, j, r) - cellFitness(costTable, v[j], j, r);
+				v[j] = tile;
+			}
+			for (int i = 0; i < genes / 100; i++) { // zamień wartość odbicia lustrzanego u 1/100 kafelków na przeciwne
+				int j = rng() % genes;
+				bool r = children.reflected(c, j);
+				fitness += cellFitness(costTable, v[j], j, !r) - cellFitness(costTable, v[j], j, r);
+				children.setReflected(c, j, !r);
+			}
+		}
+	}
+}
+
+// Tworzy nowe pokolenie w newGeneration (musi to być inna populacja niż oldGeneration; po pokoleniu wystarczy je zamienić
+// przez swap). Pary dzieci tworzone są równolegle: wątek w tworzy pary w, w + THREADS, w + 2*THREADS, ... korzystając
+// tylko ze swojego generatora liczb losowych, więc wynik zależy wyłącznie od ziarna i liczby wątków.
+
+void nextGeneration(population &oldGeneration, population &newGeneration, std::vector<cv::Mat> &tiles, std::vector<int> &costTable, ThreadPool &pool, std::vector<gaWorker> &workers) {
+	newGeneration.resize(oldGeneration.size(), oldGeneration.genes());
+
+	auto work = [&](int worker) {
+		for (int i = worker; i < oldGeneration.size() / 2; i += pool.size()) {
+			reproduce(oldGeneration, newGeneration, 2 * i, tiles, costTable, workers[worker]); // każda para ma stałe miejsce w populacji, niezależnie od kolejności pracy wątków
+		}
+	};
+	pool.run(std::ref(work)); // std::function przechowuje wtedy tylko referencję, bez przydzielania pamięci na kopię funkcji
+}
+
+#endif
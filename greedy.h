@@ -0,0 +1,212 @@
+#ifndef MOZAIKA_GREEDY_H
+#define MOZAIKA_GREEDY_H
+
+#include <cv.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "colorindex.h"
+#include "grid.h"
+#include "render.h"
+#include "sad.h"
+#include "threadpool.h"
+#include "tilecopy.h"
+#include "tiles.h"
+
+/*
+ * Wybór kafelka dla każdego obszaru obrazu niezależnie od pozostałych obszarów (program main2 i zadania greedy serwera):
+ * po średnim kolorze albo piksel po pikselu.
+ */
+
+// Dla każdego obszaru wybiera kafelek o średnim kolorze najbliższym średniemu kolorowi obszaru.
+
+void meanColorMatch(cv::Mat &pictureTarget, std::vector<cv::Scalar> &tilesAvgColor, cv::Size tileSize, std::vector<int> &bestTiles, ThreadPool &pool) {
+	colorIndex index(tilesAvgColor); // drzewo średnich kolorów kafelków - daje te same wyniki co przeszukanie wszystkich kafelków
+
+	std::vector<cv::Scalar> targetAvgColors(TILES_X * TILES_Y); // średni kolor każdego obszaru, na który ma być nałożony kafelek
+	for (int i = 0; i < TILES_X * TILES_Y; i++) {
+		int posX = (i % TILES_X) * tileSize.width;
+		int posY = (i / TILES_X) * tileSize.height;
+		targetAvgColors[i] = cv::mean(pictureTarget(cv::Rect(posX, posY, tileSize.width, tileSize.height)));
+	}
+
+	index.nearestBatch(targetAvgColors, bestTiles, pool);
+}
+
+// Wybór kafelka (z odbiciem lub bez) o najmniejszej sumie różnic pikseli z obszarem, przy remisie kafelek o mniejszym indeksie.
+// Dla każdego piksela |a - b| >= a - b, więc suma różnic pikseli kanału nie może być mniejsza od różnicy sum tego kanału
+// w obszarze i w kafelku. To ograniczenie jest takie samo dla kafelka i jego odbicia.
+// Odbicia i sumy kanałów kafelków liczone są raz, w konstruktorze; bufory robocze są osobne dla każdego wątku puli.
+
+class pixelMatcher {
+public:
+	pixelMatcher(std::vector<cv::Mat> &tiles, int workers) : tiles(tiles), tilesReflected(tiles.size()), tilesSum(tiles.size()), bounds(workers) {
+		for (int t = 0; t < tiles.size(); t++) {
+			cv::flip(tiles[t], tilesReflected[t], 1);
+			tilesSum[t] = cv::sum(tiles[t]); // sumy kanałów B, G, R kafelka - dokładne liczby całkowite
+		}
+	}
+
+	// Zwraca najlepszy kafelek dla obszaru cell, w reflect - czy jest odbity, w sad - jego sumę różnic pikseli.
+	// computed zwiększane jest o liczbę liczonych różnic pikseli (pełnych albo przerwanych).
+
+	int match(const cv::Mat &cell, int worker, bool &reflect, unsigned long long &sad, long long &computed) {
+		const int SEED_CANDIDATES = 8; // ilu kafelków o najmniejszym ograniczeniu użyć do wyznaczenia początkowego najlepszego wyniku
+
+		cv::Scalar cellSum = cv::sum(cell);
+		std::vector<std::pair<long long, int> > &bound = bounds[worker];
+		bound.resize(tiles.size());
+		for (int t = 0; t < tiles.size(); t++) {
+			long long b = 0;
+			for (int c = 0; c < 3; c++) {
+				b += std::llabs((long long)cellSum[c] - (long long)tilesSum[t][c]);
+			}
+			bound[t] = std::make_pair(b, t);
+		}
+
+		unsigned long long best = ~0ULL; // najlepsza (najmniejsza) suma różnic pikseli
+		int bestTile = 0, bestFlip = 0;
+
+		// porównanie kafelka t (obu orientacji) z obszarem; przy remisie wygrywa mniejszy indeks, a przy tym samym kafelku brak odbicia
+		auto consider = [&](int t) {
+			for (int flip = 0; flip < 2; flip++) {
+				const cv::Mat &tile = flip ? tilesReflected[t] : tiles[t];
+				unsigned long long value = sadMatBounded(cell, tile, best);
+				computed++;
+				if (value < best || (value == best && (t < bestTile || (t == bestTile && flip < bestFlip)))) {
+					best = value;
+					bestTile = t;
+					bestFlip = flip;
+				}
+			}
+		};
+
+		int seeds = std::min(SEED_CANDIDATES, (int)bound.size());
+		std::nth_element(bound.begin(), bound.begin() + seeds - 1, bound.end());
+		std::sort(bound.begin(), bound.begin() + seeds);
+		for (int j = 0; j < seeds; j++) {
+			consider(bound[j].second);
+		}
+
+		std::vector<std::pair<long long, int> >::iterator end = std::partition(bound.begin() + seeds, bound.end(),
+				[&](const std::pair<long long, int> &b) { return (unsigned long long)b.first <= best; }); // odrzuć kafelki z ograniczeniem gorszym od wyniku
+		std::sort(bound.begin() + seeds, end);
+		for (std::vector<std::pair<long long, int> >::iterator it = bound.begin() + seeds; it != end && (unsigned long long)it->first <= best; ++it) {
+			consider(it->second);
+		}
+
+		reflect = bestFlip;
+		sad = best;
+		return bestTile;
+	}
+
+	// Suma różnic pikseli obszaru i kafelka t w danej orientacji.
+
+	unsigned long long sadOf(const cv::Mat &cell, int t, bool reflect) const {
+		return sadMat(cell, reflect ? tilesReflected[t] : tiles[t]);
+	}
+
+private:
+	std::vector<cv::Mat> &tiles;
+	std::vector<cv::Mat> tilesReflected;
+	std::vector<cv::Scalar> tilesSum;
+	std::vector<std::vector<std::pair<long long, int> > > bounds; // bufory robocze każdego wątku
+};
+
+// Dla każdego obszaru wybiera kafelek (z odbiciem lub bez) o najmniejszej sumie różnic pikseli (pixelMatcher). Zwraca, ile razy
+// liczono różnicę pikseli obszaru i kafelka (pełną albo przerwaną) - pozostałe pary odrzuciło ograniczenie dolne.
+
+long long pixelMatch(cv::Mat &pictureTarget, std::vector<cv::Mat> &tiles, cv::Size tileSize, std::vector<int> &bestTiles, std::vector<bool> &bestReflect, ThreadPool &pool) {
+	pixelMatcher matcher(tiles, pool.size());
+	std::atomic<long long> computed(0); // ile razy liczono różnicę pikseli (pełną albo przerwaną)
+	std::vector<int> reflectFlags(TILES_X * TILES_Y, 0);
+	bestTiles.assign(TILES_X * TILES_Y, 0);
+
+	pool.parallelFor(TILES_X * TILES_Y, [&](int i, int worker) {
+		int posX = (i % TILES_X) * tileSize.width;
+		int posY = (i / TILES_X) * tileSize.height;
+		cv::Mat cell = pictureTarget(cv::Rect(posX, posY, tileSize.width, tileSize.height));
+
+		bool reflect;
+		unsigned long long sad;
+		long long local = 0;
+		bestTiles[i] = matcher.match(cell, worker, reflect, sad, local);
+		reflectFlags[i] = reflect;
+		computed += local;
+	});
+
+	for (int i = 0; i < TILES_X * TILES_Y; i++) {
+		bestReflect[i] = reflectFlags[i];
+	}
+	return computed;
+}
+
+// Tworzy mozaikę obrazu. Gdy tileSize jest pusty, rozmiar kafelków wynika z rozmiaru obrazu; w przeciwnym razie obraz jest
+// skalowany tak, żeby mieścił dokładnie TILES_X*TILES_Y kafelków tego rozmiaru. Gdy renderPath nie jest pusty, mozaika rysowana jest
+// tam dodatkowo z plików źródłowych kafelków w polach rozmiaru renderTile. Zwraca pustą macierz, gdy kafelków jest za mało
+// albo nie udało się zapisać mozaiki w wysokiej rozdzielczości. Statystyki dopasowania wypisywane są tylko, gdy verbose.
+
+cv::Mat createMosaic(cv::Mat pictureOryg, tileLibrary &library, cv::Size tileSize, bool pixelMode, ThreadPool &pool, cv::Size renderTile = cv::Size(),
+		const std::string &renderPath = "", bool verbose = true) {
+	if (tileSize.area() == 0) {
+		int width = pictureOryg.cols, height = pictureOryg.rows;
+		tileSize = cv::Size(width / TILES_X, height / TILES_Y); // wymiary kafelek
+	}
+	if (tileSize.area() == 0) {
+		std::cout << "Obraz jest za mały dla siatki " << TILES_X << "x" << TILES_Y << " kafelków\n";
+		return cv::Mat();
+	}
+
+	tileSet &set = library.get(tileSize); // lista plików kafelków - obrazków tworzące mozaikę, razem z ich średnimi kolorami
+	std::vector<cv::Mat> &tiles = set.tiles;
+
+	if (tiles.size() < 100) {
+		std::cout << "W bibliotece obrazów (katalog ./pictures) musi być minimum 100 plików JPG\n";
+		return cv::Mat();
+	}
+
+	cv::Mat pictureTarget;
+	cv::resize(pictureOryg, pictureTarget, cv::Size(tileSize.width * TILES_X, tileSize.height * TILES_Y)); // skopiowanie obrazka do nowej matrycy, w razie potrzeby nieco zmniejszonego do wymiaru pełnej wielokrotności kafelków
+	cv::Mat pictureMosaic = pictureTarget.clone();
+
+	std::vector<int> bestTiles; // najlepszy kafelek (najmniej różniący się od docelowego obszaru) dla każdego obszaru
+	std::vector<bool> bestReflect(TILES_X * TILES_Y, false); // czy kafelek ma być odbity lustrzanie
+
+	if (pixelMode) {
+		long long computed = pixelMatch(pictureTarget, tiles, tileSize, bestTiles, bestReflect, pool);
+		if (verbose) {
+			std::cout << "Porównano piksel po pikselu " << computed << " z " << 2LL * tiles.size() * TILES_X * TILES_Y
+					<< " par obszar-kafelek, reszta odrzucona przez ograniczenie dolne\n";
+		}
+	} else {
+		meanColorMatch(pictureTarget, set.avgColors, tileSize, bestTiles, pool);
+	}
+
+	copyTileFunction copyTile = copyTileFor(tileSize.width); // wersja kopiowania dla tej szerokości kafelków (tilecopy.h)
+	for (int i = 0; i < TILES_X * TILES_Y; i++) { // nałóż kolejne kafelki
+		int posX = (i % TILES_X) * tileSize.width;
+		int posY = (i / TILES_X) * tileSize.height;
+
+		cv::Rect roi(posX, posY, tileSize.width, tileSize.height);
+		cv::Mat tilePlace = pictureMosaic(roi); // obszar mozaiki, na który ma być nałożony kafelek
+
+		copyTile(tiles[bestTiles[i]], tilePlace, bestReflect[i]); // nałóż wybrany kafelek, w razie potrzeby odbity lustrzanie
+	}
+
+	if (verbose) {
+		std::cout << "Fitness mozaiki: " << calculateFitness(pictureTarget, pictureMosaic) // ta sama miara co w algorytmie genetycznym
+				<< " (najlepszy możliwy: " << (long long)pictureMosaic.rows * pictureMosaic.cols * 255 * 3 << ")\n";
+	}
+
+	if (!renderPath.empty() && !renderLargeMosaic(renderPath, bestTiles, bestReflect, set.sourcePaths, renderTile, pool, verbose)) {
+		return cv::Mat();
+	}
+
+	return pictureMosaic;
+}
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef MOZAIKA_GRID_H
+#define MOZAIKA_GRID_H
+
+/*
+ * Wymiary siatki mozaiki, ustawiane przed utworzeniem pierwszej mozaiki (parametr --grid=KOLUMNYxWIERSZE, domyślnie 30x30).
+ * Pola numerowane są wierszami: pole i leży w kolumnie i % TILES_X i wierszu i / TILES_X.
+ */
+
+int TILES_X = 30; // ilość kafelków w poziomie
+int TILES_Y = 30; // ilość kafelków w pionie
+
+#endif
@@ -0,0 +1,214 @@
+#ifndef MOZAIKA_ISLANDS_H
+#define MOZAIKA_ISLANDS_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <stdint.h>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+#include "ga.h"
+
+/*
+ * Model wyspowy algorytmu genetycznego: kilka populacji (wysp) ewoluuje niezależnie w osobnych procesach, a co kilka pokoleń
+ * wymieniają najlepsze osobniki przez pamięć współdzieloną POSIX (shm_open). Wymieniane są tylko chromosomy (numery kafelków
+ * i bity odbić) z fitnessem, więc wymiana jest tania, a wyspy nigdy na siebie nie czekają.
+ *
+ * Każda wyspa ma w pamięci współdzielonej swój pierścień migrantów, do którego pisze tylko ona, a czyta sąsiednia wyspa
+ * (wyspa i pobiera migrantów od wyspy i-1, ostatnia od zerowej - topologia pierścienia). Miejsca w pierścieniu chronione są
+ * licznikiem sekwencji: nieparzysty w trakcie zapisu, więc czytający odrzuca kopię, jeśli w międzyczasie zmienił się licznik.
+ * Oprócz pierścienia wyspa ma miejsca na najlepszego osobnika pokolenia zerowego i ostatniego oraz stan (numer pokolenia,
+ * najlepszy fitness), z którego proces koordynatora raportuje postęp i wybiera najlepszy wynik wszystkich wysp.
+ *
+ * Układ pamięci: islandStatus[islands] | dla każdej wyspy: slotCount miejsc (pierścień, początkowy, końcowy)
+ * Miejsce: uint64 sekwencja | int64 fitness | uint64 bity odbić[words] | uint16 numery kafelków[genes] (wyrównane do 8 bajtów)
+ */
+
+struct islandStatus { // stan wyspy, zapisywany tylko przez jej proces
+	std::atomic<long long> generation;
+	std::atomic<long long> bestFitness;
+	std::atomic<unsigned long long> published; // ilu migrantów wyspa dotąd opublikowała
+	std::atomic<int> finished; // 1 po zapisaniu końcowego osobnika
+};
+
+class islandExchange {
+public:
+	islandExchange() : data(NULL), length(0), islands(0), genes(0), migrants(0) {}
+
+	~islandExchange() {
+		if (data != NULL) {
+			munmap(data, length);
+		}
+	}
+
+	// Tworzy pamięć współdzieloną dla podanej liczby wysp. Musi być wywołana przed fork(), żeby procesy wysp ją odziedziczyły.
+
+	bool create(int islandCount, int geneCount, int migrantCount) {
+		islands = islandCount;
+		genes = geneCount;
+		migrants = migrantCount;
+		ringSlots = 2 * migrants; // miejsce na dwie kolejne migracje, żeby czytający rzadko trafiał na nadpisywane miejsce
+		slotCount = ringSlots + 2;
+		words = (genes + 63) / 64;
+		slotBytes = 16 + 8 * words + ((size_t)genes * sizeof(uint16_t) + 7) / 8 * 8;
+		length = sizeof(islandStatus) * islands + slotBytes * slotCount * islands;
+
+		static int counter = 0;
+		std::string name = "/mozaika-" + std::to_string(getpid()) + "-" + std::to_string(counter++);
+		int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+		if (fd < 0) {
+			std::cout << "Błąd tworzenia pamięci współdzielonej " << name << "\n";
+			return false;
+		}
+		shm_unlink(name.c_str()); // nazwa nie jest już potrzebna - pamięć zniknie po zakończeniu wszystkich procesów, także po awarii
+
+		bool ok = ftruncate(fd, length) == 0;
+		if (ok) {
+			data = (char *)mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			ok = data != MAP_FAILED;
+		}
+		close(fd);
+		if (!ok) {
+			data = NULL;
+			std::cout << "Błąd tworzenia pamięci współdzielonej " << name << "\n";
+			return false;
+		}
+
+		std::memset(data, 0, length); // ftruncate zeruje pamięć, ale atomiki zerowane są tu jawnie
+		selected.reserve(migrants);
+		buffer.resize(1, genes);
+		return true;
+	}
+
+	islandStatus &status(int island) {
+		return ((islandStatus *)data)[island];
+	}
+
+	// Publikuje najlepszych migrantów wyspy w jej pierścieniu.
+
+	void publish(int island, population &specimens) {
+		selectBest(specimens);
+		islandStatus &st = status(island);
+		unsigned long long published = st.published.load(std::memory_order_relaxed);
+		for (int i = 0; i < selected.size(); i++) {
+			writeSlot(island, (published + i) % ringSlots, specimens, selected[i]);
+		}
+		st.published.store(published + selected.size(), std::memory_order_release);
+	}
+
+	// Zastępuje najgorsze osobniki wyspy migrantami z poprzedniej wyspy, opublikowanymi od ostatniego odczytu
+	// (received - licznik odczytanych migrantów, prowadzony przez wyspę). Zwraca liczbę przyjętych migrantów.
+
+	int receive(int island, population &specimens, unsigned long long &received) {
+		int source = (island + islands - 1) % islands;
+		unsigned long long published = status(source).published.load(std::memory_order_acquire);
+		unsigned long long first = std::max(received, published > (unsigned long long)migrants ? published - migrants : 0ULL);
+		int accepted = 0;
+
+		for (unsigned long long n = first; n < published; n++) {
+			int worst = 0; // miejsce dla migranta: najgorszy osobnik wyspy
+			for (int i = 1; i < specimens.size(); i++) {
+				if (specimens.fitness(i) < specimens.fitness(worst)) {
+					worst = i;
+				}
+			}
+			if (readSlot(source, n % ringSlots, n, specimens, worst)) {
+				accepted++;
+			}
+		}
+		received = published;
+		return accepted;
+	}
+
+	// Zapisuje najlepszego osobnika pokolenia zerowego (which = 0) albo ostatniego (which = 1).
+
+	void publishResult(int island, int which, population &specimens, int s) {
+		writeSlot(island, ringSlots + which, specimens, s);
+		if (which == 1) {
+			status(island).finished.store(1, std::memory_order_release);
+		}
+	}
+
+	// Odczytuje osobnika zapisanego przez publishResult() do osobnika d populacji specimens.
+
+	bool readResult(int island, int which, population &specimens, int d) {
+		return readSlot(island, ringSlots + which, (unsigned long long)-1, specimens, d);
+	}
+
+private:
+	// Wybiera do selected numery migrants najlepszych osobników populacji (bez przydzielania pamięci - bufor zarezerwowany w create()).
+
+	void selectBest(population &specimens) {
+		selected.clear();
+		int count = std::min(migrants, specimens.size());
+		while (selected.size() < count) {
+			int best = -1;
+			for (int i = 0; i < specimens.size(); i++) {
+				if (std::find(selected.begin(), selected.end(), i) == selected.end() && (best < 0 || specimens.fitness(i) > specimens.fitness(best))) {
+					best = i;
+				}
+			}
+			selected.push_back(best);
+		}
+	}
+
+	char *slot(int island, int index) {
+		return data + sizeof(islandStatus) * islands + slotBytes * ((size_t)island * slotCount + index);
+	}
+
+	void writeSlot(int island, int index, population &specimens, int s) {
+		char *p = slot(island, index);
+		std::atomic<unsigned long long> &sequence = *(std::atomic<unsigned long long> *)p;
+		unsigned long long seq = sequence.load(std::memory_order_relaxed);
+
+		sequence.store(seq + 1, std::memory_order_relaxed); // nieparzysty - zapis w toku
+		std::atomic_thread_fence(std::memory_order_release);
+		*(long long *)(p + 8) = specimens.fitness(s);
+		std::memcpy(p + 16, specimens.reflectBits(s), 8 * words);
+		std::memcpy(p + 16 + 8 * words, specimens.tiles(s), genes * sizeof(uint16_t));
+		sequence.store(seq + 2, std::memory_order_release);
+	}
+
+	// Kopiuje osobnika z miejsca do osobnika d. Zwraca false, gdy miejsce jest puste albo zostało nadpisane w trakcie odczytu.
+	// n - numer migranta w pierścieniu (pomijany dla miejsc wyników), pozwala odrzucić miejsce zajęte już przez nowszego migranta.
+
+	bool readSlot(int island, int index, unsigned long long n, population &specimens, int d) {
+		char *p = slot(island, index);
+		std::atomic<unsigned long long> &sequence = *(std::atomic<unsigned long long> *)p;
+
+		unsigned long long before = sequence.load(std::memory_order_acquire);
+		if (before == 0 || before % 2 == 1) {
+			return false;
+		}
+		if (n != (unsigned long long)-1 && before / 2 != n / ringSlots + 1) { // w tym miejscu jest już migrant z późniejszego okrążenia
+			return false;
+		}
+
+		population &copy = buffer; // kopia trafia najpierw do bufora, bo osobnika d można nadpisać dopiero po sprawdzeniu spójności
+		copy.fitness(0) = *(long long *)(p + 8);
+		std::memcpy(copy.reflectBits(0), p + 16, 8 * words);
+		std::memcpy(copy.tiles(0), p + 16 + 8 * words, genes * sizeof(uint16_t));
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (sequence.load(std::memory_order_relaxed) != before) {
+			return false;
+		}
+
+		specimens.copySpecimen(d, copy, 0);
+		return true;
+	}
+
+	char *data;
+	size_t length;
+	int islands, genes, migrants;
+	int ringSlots, slotCount, words;
+	size_t slotBytes;
+	std::vector<int> selected; // bufor selectBest()
+	population buffer; // jeden osobnik - bufor readSlot()
+};
+
+#endif
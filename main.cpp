@@ -3,345 +3,794 @@
 #include <cv.h>
 #include <highgui.h>
 #include <vector>
-#include <dirent.h>
 #include <string>
-#include <cmath>
 #include <algorithm>
-#include <iterator>
+#include <random>
+#include <sstream>
+#include <thread>
 #include <time.h>
+#include <chrono>
+#include <functional>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "assignment.h"
+#include "batch.h"
+#include "checkpoint.h"
+#include "ga.h"
+#include "greedy.h"
+#include "islands.h"
+#include "render.h"
+#include "sad.h"
+#include "server.h"
+#include "telemetry.h"
+#include "tiles.h"
+#include "threadpool.h"
 
 #define WINDOW_1 "Obraz oryginalny"
 #define WINDOW_2 "Mozaika poczatkowa"
 #define WINDOW_3 "Mozaika wynikowa"
 
-const int TILES_X = 30; // ilość kafelków w poziomie
-const int TILES_Y = TILES_X; // ilość kafelków w pionie, musi być taka sama jak ilość kafelków w poziomie
-
-int POP_SIZE; // liczba osobników w każdej populacji
+int STOP_OPTION; // opcja zatrzymania programu: 1 - po osiągnięciu dużej zbieżności, 2 - po określonej ilości pokoleń
 int GEN_NUMBER; // ilość pokoleń
 
-int PROB_CROSSING; // prawdopodobieństwo krzyżowania
-int PROB_MUTATION; // prawdopodobieństwo mutacji
-
-int TOURNAMENT_SIZE; // rozmiar turnieju
-
-struct specimen { // pojedynczy osobnik populacji
-	std::vector<int> v; // tablica kolejności kafelków dla osobnika - pierwsza składowa chromosomu
-	std::vector<bool> r; // tablica odbicia lustrzanego kafelków z wektora v (true dla odbicia, false dla oryginalnego obrazka) - druga składowa chromosomu
-	cv::Mat m; // macierz wygenerowana na podstawie wektora v
-	int fitness; // współczynnik przystosowania - jak bardzo kolory są podobne do oryginalnych; czym więcej tym lepiej
-};
-
-void getTiles(std::vector<cv::Mat> &, cv::Size, const char*);
-void putTileOnMosaic(cv::Mat &, cv::Mat &, int, bool);
-void initPopulation(std::vector<specimen> &, cv::Mat, cv::Size, std::vector<cv::Mat> &);
-int calculateFitness(cv::Mat, cv::Mat);
-int tournament(std::vector<specimen> &);
-std::vector<specimen> reproduce(std::vector<specimen> &, std::vector<cv::Mat> &, cv::Mat);
-void nextGeneration(std::vector<specimen> &, std::vector<specimen> &, std::vector<cv::Mat> &, cv::Mat);
+int THREADS; // liczba wątków tworzących nowe pokolenie
+int SEED; // ziarno generatorów liczb losowych - ten sam seed i ta sama liczba wątków dają ten sam przebieg programu
+
+bool EXACT; // zamiast algorytmu genetycznego dokładne optymalne przypisanie kafelków (assignment.h)
+int REUSE_LIMIT; // ile razy można użyć jednego kafelka w dokładnym przypisaniu (0 - bez ograniczeń)
+
+int ISLANDS; // liczba wysp - populacji ewoluujących w osobnych procesach (1 - jedna populacja w tym procesie)
+int MIGRATION_INTERVAL; // co ile pokoleń wyspy wymieniają najlepsze osobniki
+int MIGRANTS; // ilu najlepszych osobników wyspa wysyła przy każdej wymianie
+
+int LEVELS; // liczba poziomów rozdzielczości fitnessu (1 - tylko pełna rozdzielczość), ewolucja zaczyna od najmniejszej
+int FINEST_LEVEL; // najdokładniejszy poziom, na którym ewoluuje populacja (0 - pełna rozdzielczość)
+int LEVEL_GENERATIONS; // po ilu pokoleniach przejść na dokładniejszy poziom (0 - gdy najlepszy fitness przestanie rosnąć)
+
+int WARM_START; // jaki procent pokolenia zerowego utworzyć z dopasowania po średnim kolorze (i jego wariantów) zamiast losowo
+
+std::string CHECKPOINT_DIR; // katalog punktów kontrolnych (checkpoint.h), pusty - bez nich
+int CHECKPOINT_EVERY; // co ile pokoleń zapisywać punkt kontrolny
+bool RESUME; // wznowić ewolucję z punktu kontrolnego, jeśli istnieje
+
+bool QUIET; // bez postępu kolejnych pokoleń na standardowym wyjściu (zadania serwera - w dzienniku serwera jedna linia na zadanie)
+
+cv::Size RENDER_TILE; // rozmiar pola mozaiki rysowanej z plików źródłowych do pliku TIFF (render.h), pusty - bez niej
+
+telemetryLog telemetry; // pomiary kolejnych pokoleń, zapisywane tylko gdy podano --telemetry=plik
+
+bool readParameters(options &, bool);
+cv::Mat evolveMosaic(cv::Mat, tileLibrary &, cv::Size, ThreadPool &, cv::Mat *, const std::string &renderPath = "", const std::string &checkpointPath = "");
+cv::Mat solveMosaic(std::vector<int> &, tileSet &, std::vector<cv::Mat> &, cv::Size, ThreadPool &, cv::Mat *, const std::string &);
+cv::Mat finishMosaic(population &, int, tileSet &, std::vector<cv::Mat> &, cv::Size, ThreadPool &, const std::string &);
+void evolve(population &, std::vector<cv::Mat> &, std::vector<std::vector<int> > &, int, ThreadPool &, std::vector<gaWorker> &, long long, bool,
+		evolutionState &, const std::string &, const std::function<void(int, double, std::vector<int> &)> &);
+std::vector<int> checkpointParameters(int, int, int);
+bool evolveIslands(std::vector<cv::Mat> &, std::vector<std::vector<int> > &, int, int, long long, const std::vector<int> &, population &);
+void runIsland(int, islandExchange &, std::vector<cv::Mat> &, std::vector<std::vector<int> > &, int, int, long long, const std::vector<int> &);
+int finalSpecimen(population &, std::vector<std::vector<int> > &, int, cv::Mat, std::vector<cv::Mat> &, cv::Size);
+bool serve(options &, tileLibrary &);
+bool serveJob(const options &, tileLibrary &, ThreadPool &, gridLock &, cv::Size, std::string &);
 int readParameter(std::string, int, bool mustBeEven = false);
 int readParameter(std::string, int, int, int);
 int readPercent(std::string, int);
 
 int main(int argc, char* argv[]) {
-	srand(time(NULL));
+	options opts;
+	if (!parseOptions(argc, argv, opts)) {
+		return EXIT_FAILURE;
+	}
 
-	if (argc < 2) { // czy podano argument przy uruchamianiu programu
+	std::vector<std::string> inputs = expandInputs(opts);
+	if (inputs.empty() && !opts.has("serve")) { // czy podano argument przy uruchamianiu programu
 		std::cout << "Nie podano obrazu do przetworzenia\n";
 		return EXIT_FAILURE;
 	}
 
-	cv::Mat pictureOryg; // oryginalny wczytany obraz (format BGR)
+	bool interactive = !opts.has("output"); // bez --output program pyta o parametry i pokazuje wynik w okienkach
+	bool valid = true;
+	cv::Size tileSize = opts.getSize("tile", cv::Size(0, 0), valid); // stały rozmiar kafelków, domyślnie wyliczany z rozmiaru obrazu
+	RENDER_TILE = opts.getSize("render-tile", cv::Size(0, 0), valid);
+	cv::Size grid = opts.getSize("grid", cv::Size(TILES_X, TILES_Y), valid); // wymiary siatki: kolumny x wiersze
+	TILES_X = grid.width;
+	TILES_Y = grid.height;
+	if (!valid) {
+		return EXIT_FAILURE;
+	}
+	if (opts.has("telemetry") && !telemetry.open(opts.get("telemetry", ""))) {
+		return EXIT_FAILURE;
+	}
 
-	char* filename = argv[1];
-	pictureOryg = cv::imread(filename, CV_LOAD_IMAGE_COLOR); // wczytaj podany obrazek
+	tileLibrary library("pictures"); // kafelki wczytywane raz dla każdego rozmiaru, wspólne dla wszystkich obrazów
+
+	if (opts.has("serve")) { // tryb serwera
+		return serve(opts, library) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (!interactive) { // tryb wsadowy
+		if (!readParameters(opts, false)) {
+			return EXIT_FAILURE;
+		}
+
+		ThreadPool pool(THREADS);
+		std::string directory = opts.get("output", ".");
+		int failures = runBatch(inputs, directory, opts.get("ext", "png"), [&](const batchItem &item) {
+			return evolveMosaic(item.picture, library, tileSize, pool, NULL, RENDER_TILE.area() > 0 ? largeMosaicPath(item.path, directory) : "",
+					CHECKPOINT_DIR.empty() ? "" : outputPath(item.path, CHECKPOINT_DIR, "ckpt"));
+		});
+		return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	cv::Mat pictureOryg; // oryginalny wczytany obraz (format BGR)
+	pictureOryg = cv::imread(inputs[0], CV_LOAD_IMAGE_COLOR); // wczytaj podany obrazek
 
 	if (!pictureOryg.data) {
 		std::cout << "Błąd odczytu obrazu\n";
 		return EXIT_FAILURE;
 	}
 
-	int width = pictureOryg.cols, height = pictureOryg.rows;
-	cv::Size tileSize(width / TILES_X, height / TILES_Y); // wymiary kafelek
-
-	std::vector<cv::Mat> tiles; // lista plików kafelków - obrazków tworzące mozaikę
-	getTiles(tiles, tileSize, "pictures"); // załaduj listę kafelków
-
-	if (tiles.size() < 100) {
+	if (tileSize.area() == 0) {
+		tileSize = cv::Size(pictureOryg.cols / TILES_X, pictureOryg.rows / TILES_Y); // wymiary kafelek
+	}
+	if (tileSize.area() == 0) {
+		std::cout << "Obraz jest za mały dla siatki " << TILES_X << "x" << TILES_Y << " kafelków\n";
+		return EXIT_FAILURE;
+	}
+	if (library.get(tileSize).tiles.size() < 100) { // załaduj listę kafelków jeszcze przed pytaniami o parametry
 		std::cout << "W bibliotece obrazów (katalog ./pictures) musi być minimum 100 plików JPG\n";
 		return EXIT_FAILURE;
 	}
 
+	if (!readParameters(opts, true)) {
+		return EXIT_FAILURE;
+	}
+
+	ThreadPool pool(THREADS);
+	cv::Mat pictureRandomMosaic; // mozaika najlepszego osobnika z zerowego pokolenia
+	cv::Mat pictureMosaic = evolveMosaic(pictureOryg, library, tileSize, pool, &pictureRandomMosaic); // mozaika najlepszego osobnika ostatniego pokolenia
+
+	cv::namedWindow(WINDOW_1, CV_WINDOW_KEEPRATIO); // okno oryginalnego obrazu
+	cv::namedWindow(WINDOW_2, CV_WINDOW_KEEPRATIO); // okno początkowej mozaiki
+	cv::namedWindow(WINDOW_3, CV_WINDOW_KEEPRATIO); // okno wynikowej mozaiki
+
+	cv::imshow(WINDOW_1, pictureOryg); // pokaż oryginalny obrazek
+	cv::imshow(WINDOW_2, pictureRandomMosaic); // pokaż początkową mozaikę
+	cv::imshow(WINDOW_3, pictureMosaic); // pokaż wynikową mozaikę
+
+	int key;
+	do {
+		key = cv::waitKey(0); // czekaj na naciśnięcie ESC
+	} while (key != 27);
+
+	cv::destroyAllWindows(); // zamknij wszystkie okienka
+
+	return EXIT_SUCCESS;
+}
+
+// Ustawia parametry algorytmu: w trybie interaktywnym pyta o nie użytkownika, w trybie wsadowym bierze je z opcji
+// (--exact, --reuse, --stop, --generations, --population, --tournament, --crossing, --mutation, --threads, --seed, --islands,
+// --migration, --migrants, --levels, --finest, --level-generations, --warm-start, --checkpoint, --checkpoint-every, --resume),
+// z tymi samymi wartościami domyślnymi.
+
+bool readParameters(options &opts, bool interactive) {
+	int defaultThreads = std::max(1u, std::thread::hardware_concurrency());
+	int defaultSeed = time(NULL) % 1000000;
+
+	if (!interactive) {
+		bool valid = true;
+		EXACT = opts.has("exact");
+		REUSE_LIMIT = opts.getInt("reuse", 1, 0, 1000000000, valid);
+		STOP_OPTION = opts.getInt("stop", 1, 1, 2, valid);
+		GEN_NUMBER = STOP_OPTION == 2 ? opts.getInt("generations", 50, 0, 1000000000, valid) : 2;
+		POP_SIZE = opts.getInt("population", 300, 2, 1000000000, valid);
+		TOURNAMENT_SIZE = opts.getInt("tournament", POP_SIZE / 10, 0, std::min(100, POP_SIZE - 1), valid); // mniejszy od populacji - turniej całej populacji wybiera zawsze tego samego osobnika, a ojciec musi być inny niż matka
+		PROB_CROSSING = opts.getInt("crossing", 95, 0, 100, valid);
+		PROB_MUTATION = opts.getInt("mutation", 2, 0, 100, valid);
+		THREADS = opts.getInt("threads", defaultThreads, 0, 4096, valid);
+		SEED = opts.getInt("seed", defaultSeed, 0, 2147483647, valid);
+		ISLANDS = opts.getInt("islands", 1, 1, 256, valid);
+		MIGRATION_INTERVAL = opts.getInt("migration", 10, 1, 1000000000, valid);
+		MIGRANTS = opts.getInt("migrants", 2, 1, std::max(1, POP_SIZE / 2), valid);
+		LEVELS = opts.getInt("levels", 1, 1, 8, valid);
+		FINEST_LEVEL = opts.getInt("finest", 0, 0, LEVELS - 1, valid);
+		LEVEL_GENERATIONS = opts.getInt("level-generations", 0, 0, 1000000000, valid);
+		WARM_START = opts.getInt("warm-start", 0, 0, 100, valid);
+		CHECKPOINT_DIR = opts.get("checkpoint", "");
+		CHECKPOINT_EVERY = opts.getInt("checkpoint-every", 10, 1, 1000000000, valid);
+		RESUME = opts.has("resume");
+
+		if (POP_SIZE % 2 == 1) {
+			std::cout << "Parametr --population musi być podzielny przez 2\n";
+			valid = false;
+		}
+		if (RESUME && CHECKPOINT_DIR.empty()) {
+			std::cout << "Parametr --resume wymaga podania katalogu punktów kontrolnych (--checkpoint=katalog)\n";
+			valid = false;
+		}
+		if (valid && !CHECKPOINT_DIR.empty() && !makeDirectory(CHECKPOINT_DIR)) { // jak katalog wyników w checkOutputs()
+			valid = false;
+		}
+		if (!QUIET) {
+			std::cout << "Ziarno losowania: " << SEED << "\n";
+		}
+		return valid;
+	}
+
+	std::cout << "Możliwe metody:\n"
+			<< "    (1) Algorytm genetyczny\n"
+			<< "    (2) Dokładne optymalne przypisanie kafelków z ograniczeniem liczby użyć\n\n";
+	EXACT = readParameter("Podaj metodę", 1, 1, 2) == 2;
+
+	if (EXACT) {
+		REUSE_LIMIT = readParameter("Podaj ile razy można użyć jednego kafelka (0 - bez ograniczeń)", 1);
+		THREADS = readParameter("Podaj liczbę wątków", defaultThreads);
+		ISLANDS = 1;
+		LEVELS = 1;
+		FINEST_LEVEL = 0;
+		return true;
+	}
+
 	std::cout << "Możliwe opcje zatrzymania programu:\n"
 			<< "    (1) Po osiągnięciu dużej zbieżności\n"
 			<< "    (2) Po określonej ilości pokoleń\n"
 			<< "Program zostanie zatrzymany zawsze po osiągnięciu maksymalnej wartości fitness\n\n";
-	int stopOption = readParameter("Podaj opcję zatrzymania programu", 1, 1, 2);
+	STOP_OPTION = readParameter("Podaj opcję zatrzymania programu", 1, 1, 2);
 
-	if (stopOption == 2) {
+	if (STOP_OPTION == 2) {
 		GEN_NUMBER = readParameter("Podaj ilość pokoleń", 50);
 	} else {
 		GEN_NUMBER = 2; // aby pętla pokoleń wystartowała
 	}
 
-	POP_SIZE = readParameter("Podaj rozmiar populacji", 300, true);
+	POP_SIZE = std::max(2, readParameter("Podaj rozmiar populacji", 300, true)); // para rodziców wymaga co najmniej dwóch osobników
 	
 	TOURNAMENT_SIZE = POP_SIZE / 10; // domyślny rozmiar turnieju: 1/10 populacji
-	TOURNAMENT_SIZE = readPercent("Podaj rozmiar turnieju", TOURNAMENT_SIZE);
+	TOURNAMENT_SIZE = readParameter("Podaj rozmiar turnieju", TOURNAMENT_SIZE, 0, std::min(100, POP_SIZE - 1));
 	
 	PROB_CROSSING = readPercent("Podaj prawdopodobieństwo krzyżowania", 95);
 	PROB_MUTATION = readPercent("Podaj prawdopodobieństwo mutacji", 2);
 
-	int maxFitness = width * height * 255 * 3; // najlepszy możliwy fitness = ilość pixeli * 3 kolory RGB (obrazek idealnie taki sam)
-
-	std::cout << "\nNajgorszy możliwy fitness: 0\n"
-			<< "Najlepszy możliwy fitness: " << maxFitness << "\n\n";
+	THREADS = readParameter("Podaj liczbę wątków", defaultThreads);
+	SEED = readParameter("Podaj ziarno losowania", defaultSeed);
 
-	std::vector<specimen> specimens; // tablica osobników
-	initPopulation(specimens, pictureOryg, tileSize, tiles); // stwórz początkową populację
-
-	int bestSpecimen = 0;
-	for (int i = 1; i < specimens.size(); i++) {
-		if (specimens[i].fitness > specimens[i].fitness) {
-			bestSpecimen = i;
-		}
+	ISLANDS = readParameter("Podaj liczbę wysp (osobnych populacji, każda w swoim procesie)", 1, 1, 256);
+	MIGRATION_INTERVAL = 10;
+	MIGRANTS = 2;
+	if (ISLANDS > 1) {
+		MIGRATION_INTERVAL = readParameter("Podaj co ile pokoleń wyspy wymieniają osobniki", MIGRATION_INTERVAL, 1, 1000000000);
+		MIGRANTS = readParameter("Podaj liczbę wymienianych osobników", MIGRANTS, 1, std::max(1, POP_SIZE / 2));
 	}
-	std::cout << "Stworzono pokolenie: 0; Najlepszy fitness: " << specimens[bestSpecimen].fitness << "\n";
 
-	cv::Mat pictureRandomMosaic = specimens[bestSpecimen].m; // zapamiętaj mozaikę najlepszego osobnika z zerowego pokolenia
+	LEVELS = readParameter("Podaj liczbę poziomów rozdzielczości fitnessu (1 - tylko pełna rozdzielczość)", 1, 1, 8);
+	FINEST_LEVEL = 0;
+	LEVEL_GENERATIONS = 0;
 
-	int lastBestFitness = 0;
-	int i = 1;
-	while (true) {
-		if (i > GEN_NUMBER && stopOption == 2) { // stop pętli po ilości pokoleń
-			break;
-		}
+	WARM_START = readPercent("Podaj jaki procent pokolenia zerowego utworzyć z dopasowania po średnim kolorze", 0);
 
-		nextGeneration(specimens, specimens, tiles, pictureOryg);
+	return true;
+}
 
-		int bestFitness = specimens[0].fitness;
-		for (int j = 1; j < specimens.size(); j++) {
-			if (specimens[j].fitness > bestFitness) {
-				bestFitness = specimens[j].fitness;
-			}
-		}
-		std::cout << "Stworzono pokolenie: " << i << "; Najlepszy fitness: " << bestFitness << "\n";
+// Tworzy mozaikę obrazu algorytmem genetycznym i zwraca mozaikę najlepszego osobnika ostatniego pokolenia. Gdy tileSize jest pusty,
+// rozmiar kafelków wynika z rozmiaru obrazu; w przeciwnym razie obraz jest skalowany do TILES_X*TILES_Y kafelków tego rozmiaru.
+// Jeśli randomMosaic nie jest NULL, zapisywana jest tam mozaika najlepszego osobnika z zerowego pokolenia. Gdy renderPath nie jest
+// pusty, wynik rysowany jest tam dodatkowo z plików źródłowych kafelków w polach rozmiaru RENDER_TILE. Gdy checkpointPath nie jest
+// pusty, co CHECKPOINT_EVERY pokoleń zapisywany jest tam punkt kontrolny, a przy RESUME ewolucja wznawiana jest z istniejącego.
+// Zwraca pustą macierz, gdy kafelków jest za mało albo punkt kontrolny nie pasuje do obrazu lub parametrów.
+
+cv::Mat evolveMosaic(cv::Mat pictureOryg, tileLibrary &library, cv::Size tileSize, ThreadPool &pool, cv::Mat *randomMosaic, const std::string &renderPath,
+		const std::string &checkpointPath) {
+	if (tileSize.area() == 0) {
+		tileSize = cv::Size(pictureOryg.cols / TILES_X, pictureOryg.rows / TILES_Y); // wymiary kafelek
+	} else {
+		cv::resize(pictureOryg, pictureOryg, cv::Size(tileSize.width * TILES_X, tileSize.height * TILES_Y));
+	}
+	if (tileSize.area() == 0) {
+		std::cout << "Obraz jest za mały dla siatki " << TILES_X << "x" << TILES_Y << " kafelków\n";
+		return cv::Mat();
+	}
 
-		if (bestFitness == maxFitness) { // stop pętli po osiągnięciu najlepszego możliwego rezultatu (niemal nieprawdopodobne bez specjalnie przygotowanych kafelków)
-			std::cout << "\nOsiągnięto osobnika z maksymalną wartością fitness\n\n";
-			break;
-		}
-		if (stopOption == 1 && bestFitness == lastBestFitness) { // stop pętli po osiągnięciu dużej zbieżności
-			std::cout << "\nW dwóch pokoleniach pod rząd wystąpił ten sam najlepszy współczynnik fitness, program nie osiągnie już dużo lepszych rezultatów przez zbieżność osobników\n\n";
-			break;
-		}
-		lastBestFitness = bestFitness;
+	tileSet &set = library.get(tileSize);
+	std::vector<cv::Mat> &libraryTiles = set.tiles;
 
-		i++;
+	if (libraryTiles.size() < 100) {
+		std::cout << "W bibliotece obrazów (katalog ./pictures) musi być minimum 100 plików JPG\n";
+		return cv::Mat();
 	}
-
-	bestSpecimen = 0;
-	for (int i = 1; i < specimens.size(); i++) {
-		if (specimens[i].fitness > specimens[i].fitness) {
-			bestSpecimen = i;
-		}
+	if (libraryTiles.size() > MAX_TILES) {
+		std::cout << "Użyte zostanie tylko pierwsze " << MAX_TILES << " z " << libraryTiles.size() << " kafelków\n";
 	}
+	std::vector<cv::Mat> tiles(libraryTiles.begin(), libraryTiles.begin() + std::min<size_t>(libraryTiles.size(), MAX_TILES)); // lista kafelków - obrazków tworzące mozaikę
 
-	cv::Mat pictureMosaic = specimens[bestSpecimen].m; // pokaż mozaikę najlepszego osobnika ostatniego pokolenia
+	std::vector<gaWorker> workers; // osobny generator liczb losowych dla każdego wątku, dla każdego obrazu od nowa z tego samego ziarna
+	initWorkers(workers, pool.size(), SEED);
 
-	cv::namedWindow(WINDOW_1, CV_WINDOW_KEEPRATIO); // okno oryginalnego obrazu
-	cv::namedWindow(WINDOW_2, CV_WINDOW_KEEPRATIO); // okno początkowej mozaiki
-	cv::namedWindow(WINDOW_3, CV_WINDOW_KEEPRATIO); // okno wynikowej mozaiki
-
-	cv::imshow(WINDOW_1, pictureOryg); // pokaż oryginalny obrazek
-	cv::imshow(WINDOW_2, pictureRandomMosaic); // pokaż początkową mozaikę
-	cv::imshow(WINDOW_3, pictureMosaic); // pokaż wynikową mozaikę
+	int width = pictureOryg.cols, height = pictureOryg.rows;
+	long long maxFitness = (long long)width * height * 255 * 3; // najlepszy możliwy fitness = ilość pixeli * 3 kolory RGB (obrazek idealnie taki sam)
 
-	int key;
-	do {
-		key = cv::waitKey(0); // czekaj na naciśnięcie ESC
-	} while (key != 27);
+	if (!QUIET) {
+		std::cout << "\nNajgorszy możliwy fitness: 0\n"
+				<< "Najlepszy możliwy fitness: " << maxFitness << "\n\n";
+	}
 
-	cv::destroyAllWindows(); // zamknij wszystkie okienka
+	// fitness każdej trójki (kafelek, pole siatki, odbicie) na kolejnych poziomach rozdzielczości - fitness osobnika to suma
+	// wartości z tablicy bieżącego poziomu; poziom 0 to pełna rozdzielczość
+	std::vector<std::vector<int> > costTables;
+	int levels = buildCostPyramid(costTables, pictureOryg, tiles, EXACT ? 1 : LEVELS, EXACT ? 0 : FINEST_LEVEL, pool);
+	int finest = std::min(FINEST_LEVEL, levels - 1);
+	if (levels < LEVELS && !EXACT) {
+		std::cout << "Kafelki " << tileSize.width << "x" << tileSize.height << " pozwalają tylko na " << levels << " poziomów rozdzielczości\n";
+	}
 
-	return EXIT_SUCCESS;
-}
+	if (EXACT) {
+		return solveMosaic(costTables[0], set, tiles, tileSize, pool, randomMosaic, renderPath);
+	}
 
-// Tworzy tablicę kafelków określonego rozmiaru na podstawie obrazów z podanego katalogu.
+	std::vector<int> seedTiles; // układ z dopasowania po średnim kolorze (greedy.h), od którego zaczyna część pokolenia zerowego
+	if (WARM_START > 0) {
+		std::vector<cv::Scalar> avgColors(set.avgColors.begin(), set.avgColors.begin() + tiles.size());
+		meanColorMatch(pictureOryg, avgColors, tileSize, seedTiles, pool);
+	}
 
-void getTiles(std::vector<cv::Mat> &tiles, cv::Size tileSize, const char* directory) {
-	DIR *dir;
-	struct dirent *ent;
+	if (ISLANDS > 1) {
+		if (!checkpointPath.empty()) {
+			std::cout << "Punkty kontrolne (--checkpoint) nie są zapisywane w trybie wysp\n";
+		}
+		population best; // najlepszy osobnik wszystkich wysp z pokolenia zerowego (0) i ostatni osobnik każdej wyspy (1 + numer wyspy)
+		if (!evolveIslands(tiles, costTables, finest, pool.size(), maxFitness, seedTiles, best)) {
+			return cv::Mat();
+		}
+		if (randomMosaic != NULL) {
+			*randomMosaic = renderMosaic(best, 0, tiles, tileSize);
+		}
+		best.fitness(0) = -1; // osobnik pokolenia zerowego nie bierze udziału w wyborze wyniku
+		int bestSpecimen = finalSpecimen(best, costTables, finest, pictureOryg, tiles, tileSize);
+		std::cout << "\nNajlepszy fitness wszystkich wysp: " << best.fitness(bestSpecimen) << "\n\n";
+		return finishMosaic(best, bestSpecimen, set, tiles, tileSize, pool, renderPath);
+	}
 
-	if ((dir = opendir(directory)) != NULL) {
-		while ((ent = readdir(dir)) != NULL) {
-			std::string fn = ent->d_name; // pobierz nazwę pliku
-			if (fn.substr(fn.find_last_of(".") + 1) == "jpg") { // czy to plik .jpg
-				fn = "pictures/" + fn;
+	telemetry.beginRun();
+	std::chrono::steady_clock::time_point generationStart = std::chrono::steady_clock::now();
 
-				cv::Mat tile = cv::imread(fn, CV_LOAD_IMAGE_COLOR);
-				cv::resize(tile, tile, tileSize);
-				tiles.push_back(tile); // dodaj do tablicy kafelków
-			}
+	population specimens; // tablica osobników
+	evolutionState state = {1, (int)costTables.size() - 1, 1, 0}; // ewolucja zaczyna od pokolenia 1 na najmniej dokładnym poziomie
+	bool resumed = RESUME && !checkpointPath.empty() && access(checkpointPath.c_str(), F_OK) == 0;
+	if (resumed) {
+		if (!loadCheckpoint(checkpointPath, checkpointParameters(pool.size(), tiles.size(), finest), costTablesChecksum(costTables), state, workers, specimens)) {
+			return cv::Mat();
+		}
+		if (!QUIET) {
+			std::cout << "Wznowiono z punktu kontrolnego " << checkpointPath << " od pokolenia " << state.generation << "\n";
 		}
-		closedir(dir);
 	} else {
-		std::cout << "Błąd odczytu biblioteki obrazów\n";
+		initPopulation(specimens, costTables.back(), tiles.size(), workers[0].rng); // stwórz początkową populację, oceniając ją na najmniej dokładnym poziomie
+		if (!seedTiles.empty()) {
+			seedPopulation(specimens, costTables.back(), tiles.size(), seedTiles, std::max(1, POP_SIZE * WARM_START / 100), workers[0].rng);
+		}
+		if (telemetry.isOpen()) {
+			telemetry.write(0, std::chrono::duration<double>(std::chrono::steady_clock::now() - generationStart).count(), populationStats(specimens));
+		}
 	}
-}
 
-// Umieszcza kafelek na matrycy mozaiki. Pozycja liczona jest od lewej do prawej od góry do dołu, max pozycja = TILES_X*TILES_Y.
+	int bestSpecimen = bestSpecimenIndex(specimens);
+	if (!resumed && !QUIET) {
+		std::cout << "Stworzono pokolenie: 0; Najlepszy fitness: " << specimens.fitness(bestSpecimen) << "\n";
+	}
 
-void putTileOnMosaic(cv::Mat &mosaic, cv::Mat &tile, int position, bool reflect) {
-	int posX = (position % TILES_Y) * tile.cols;
-	int posY = (position / TILES_X) * tile.rows;
+	if (randomMosaic != NULL) {
+		*randomMosaic = renderMosaic(specimens, bestSpecimen, tiles, tileSize); // zapamiętaj mozaikę najlepszego osobnika z zerowego pokolenia
+	}
 
-	cv::Rect roi(posX, posY, tile.cols, tile.rows);
-	cv::Mat tilePlace = mosaic(roi);
-	tile.copyTo(tilePlace);
+	evolve(specimens, tiles, costTables, finest, pool, workers, maxFitness, !QUIET, state, checkpointPath, [&](int generation, double seconds, std::vector<int> &) {
+		if (telemetry.isOpen()) {
+			telemetry.write(generation, seconds, populationStats(specimens));
+		}
+	});
 
-	if (reflect) {
-		cv::flip(tilePlace, tilePlace, 1); // odbicie lustrzane kafelka
+	bestSpecimen = finalSpecimen(specimens, costTables, finest, pictureOryg, tiles, tileSize);
+	if (levels > 1 && !QUIET) {
+		std::cout << "Fitness wyniku w pełnej rozdzielczości: " << specimens.fitness(bestSpecimen) << "\n";
 	}
-}
+	cv::Mat mosaic = finishMosaic(specimens, bestSpecimen, set, tiles, tileSize, pool, renderPath);
 
-// Tworzy początkową populację z losowymi układami kafelków.
+	telemetry.printSummary();
+	return mosaic;
+}
 
-void initPopulation(std::vector<specimen> &specimens, cv::Mat pictureOryg, cv::Size tileSize, std::vector<cv::Mat> &tiles) {
-	specimens.resize(POP_SIZE); // nadaj rozmiar tablicy na ilość osobników w populacji (tworzy puste osobniki)
+// Rysuje mozaikę osobnika s z kafelków użytych przy dopasowaniu, a gdy renderPath nie jest pusty, także z plików źródłowych
+// kafelków w polach rozmiaru RENDER_TILE (render.h). Zwraca pustą macierz, gdy nie udało się zapisać tej drugiej.
 
-	for (int i = 0; i < POP_SIZE; i++) { // ustaw początkowe osobniki
-		specimens[i].m = cv::Mat(tileSize.height * TILES_Y, tileSize.width * TILES_X, CV_8UC3); // stwórz osobnikowi pustą macierz
-		specimens[i].v.resize(TILES_X * TILES_Y); // nadaj rozmiar tablicy kafelków osobnika równy ilości kafelków
-		specimens[i].r.resize(TILES_X * TILES_Y);
-		for (int j = 0; j < TILES_X * TILES_Y; j++) { // stwórz kafelki
-			specimens[i].v[j] = rand() % tiles.size(); // ustaw losowy kafelek
-			specimens[i].r[j] = rand() % 2; // przypisz kafelkowi losową wartość odbicia lustrzanego (true/false)
-			putTileOnMosaic(specimens[i].m, tiles.at(specimens[i].v[j]), j, specimens[i].r[j]); // wrzuć kafelek na macierz
+cv::Mat finishMosaic(population &specimens, int s, tileSet &set, std::vector<cv::Mat> &tiles, cv::Size tileSize, ThreadPool &pool, const std::string &renderPath) {
+	if (!renderPath.empty()) {
+		std::vector<int> cellTiles(specimens.tiles(s), specimens.tiles(s) + specimens.genes());
+		std::vector<bool> cellReflect(specimens.genes());
+		for (int i = 0; i < specimens.genes(); i++) {
+			cellReflect[i] = specimens.reflected(s, i);
+		}
+		if (!renderLargeMosaic(renderPath, cellTiles, cellReflect, set.sourcePaths, RENDER_TILE, pool, !QUIET)) {
+			return cv::Mat();
 		}
-		specimens[i].fitness = calculateFitness(pictureOryg, specimens[i].m); // wylicz i zapisz fitness osobnika
 	}
+	return renderMosaic(specimens, s, tiles, tileSize);
 }
 
-// Wylicza przystosowanie danej mozaiki - jak bardzo jej kolory są podobne do oryginalnych. Czym więcej tym lepiej.
+// Tworzy mozaikę dokładnym optymalnym przypisaniem kafelków, w którym każdy kafelek użyty jest co najwyżej REUSE_LIMIT razy.
+// Jeśli randomMosaic nie jest NULL, zapisywane jest tam optimum bez ograniczenia liczby użyć, dla porównania.
+// Zwraca pustą macierz, gdy kafelków jest za mało, żeby przy tym ograniczeniu zapełnić wszystkie pola.
+
+cv::Mat solveMosaic(std::vector<int> &costTable, tileSet &set, std::vector<cv::Mat> &tiles, cv::Size tileSize, ThreadPool &pool, cv::Mat *randomMosaic,
+		const std::string &renderPath) {
+	int cells = TILES_X * TILES_Y;
+	population result; // osobnik 0 - optimum bez ograniczenia, 1 - z ograniczeniem
+	result.resize(2, cells);
+
+	for (int i = 0; i < 2; i++) {
+		std::vector<int> cellTile;
+		std::vector<bool> cellReflect;
+		long long fitness;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		if (!optimalAssignment(costTable, cells, tiles.size(), i == 0 ? 0 : REUSE_LIMIT, pool, cellTile, cellReflect, fitness)) {
+			std::cout << "Za mało kafelków: " << tiles.size() << " kafelków użytych najwyżej " << REUSE_LIMIT << " razy nie wypełni " << cells << " pól\n";
+			return cv::Mat();
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
-int calculateFitness(cv::Mat matA, cv::Mat matB) {
-	int diff = 0; // podobieństwo kolorów, max = width * height * 255 * 3
+		for (int c = 0; c < cells; c++) {
+			result.tiles(i)[c] = cellTile[c];
+			result.setReflected(i, c, cellReflect[c]);
+		}
+		result.fitness(i) = fitness;
 
-	for (int i = 0; i < matB.rows; i++) {
-		for (int j = 0; j < matB.cols; j++) {
-			for (int k = 0; k < 3; k++) {
-				diff += 255 - std::abs(matA.at<cv::Vec3b>(i, j)[k] - matB.at<cv::Vec3b>(i, j)[k]); // dodaj różnicę kolorów na tym pixelu do sumy
-			}
+		if (i == 0 && !QUIET) {
+			std::cout << "Optimum bez ograniczenia użyć kafelków: fitness " << fitness << "\n";
+		} else if (!QUIET) {
+			std::cout << "Optimum z każdym kafelkiem użytym najwyżej " << REUSE_LIMIT << " razy: fitness " << fitness << " (" << seconds << " s)\n";
+		}
+		if (REUSE_LIMIT <= 0 || REUSE_LIMIT >= cells) { // bez ograniczenia oba wyniki są takie same
+			result.copySpecimen(1, result, 0);
+			break;
 		}
 	}
 
-	return diff;
+	if (randomMosaic != NULL) {
+		*randomMosaic = renderMosaic(result, 0, tiles, tileSize);
+	}
+	return finishMosaic(result, 1, set, tiles, tileSize, pool, renderPath);
 }
 
-// Wybiera osobnika metodą selekcji turniejowej (losuje kilku osobników z populacji i wybiera najlepszego z nich).
-
-int tournament(std::vector<specimen> &specimens) {
-	std::vector<int> selectedNumbers; // tablica numerów osobników wybranych do turnieju - bez powtórzeń
+// Tworzy kolejne pokolenia populacji specimens aż do spełnienia warunku zatrzymania. Po każdym pokoleniu wywołuje
+// afterGeneration(numer pokolenia, czas tworzenia pokolenia w sekundach, tablica kosztów bieżącego poziomu). verbose - wypisywanie
+// postępu na ekran. state - stan pętli pokoleń, od którego zaczyna ewolucja (pokolenie 1 na najmniej dokładnym poziomie albo stan
+// wczytany z punktu kontrolnego); gdy checkpointPath nie jest pusty, co CHECKPOINT_EVERY pokoleń zapisywany jest tam punkt kontrolny.
+//
+// Ewolucja zaczyna się na najmniej dokładnym poziomie costTables (ostatnia tablica) i schodzi poziom niżej, gdy najlepszy fitness
+// przestanie rosnąć albo po LEVEL_GENERATIONS pokoleniach, aż do poziomu finest. Przy zmianie poziomu fitness całej populacji
+// jest przeliczany z nowej tablicy. Warunek zatrzymania po zbieżności sprawdzany jest dopiero na poziomie finest.
+
+void evolve(population &specimens, std::vector<cv::Mat> &tiles, std::vector<std::vector<int> > &costTables, int finest, ThreadPool &pool,
+		std::vector<gaWorker> &workers, long long maxFitness, bool verbose, evolutionState &state, const std::string &checkpointPath,
+		const std::function<void(int, double, std::vector<int> &)> &afterGeneration) {
+	population offspring; // miejsce na następne pokolenie - populacje zamieniają się rolami po każdym pokoleniu
+	uint64_t tablesChecksum = checkpointPath.empty() ? 0 : costTablesChecksum(costTables);
+	while (true) {
+		int i = state.generation;
+		if (i > GEN_NUMBER && STOP_OPTION == 2) { // stop pętli po ilości pokoleń
+			break;
+		}
 
-	do { // losowanie numerów osobników bez powtórzeń
-		int i = rand() % POP_SIZE;
-		if (std::find(selectedNumbers.begin(), selectedNumbers.end(), i) == selectedNumbers.end()) { // jeśli tablica numerów nie zawiera wylosowanej liczby
-			selectedNumbers.push_back(i);
+		std::vector<int> &costTable = costTables[state.level];
+		std::chrono::steady_clock::time_point generationStart = std::chrono::steady_clock::now();
+		nextGeneration(specimens, offspring, tiles, costTable, pool, workers);
+		specimens.swap(offspring);
+		afterGeneration(i, std::chrono::duration<double>(std::chrono::steady_clock::now() - generationStart).count(), costTable);
+
+		long long bestFitness = specimens.fitness(bestSpecimenIndex(specimens));
+		if (verbose) {
+			std::cout << "Stworzono pokolenie: " << i << "; Najlepszy fitness: " << bestFitness;
+			if (costTables.size() > 1) {
+				std::cout << " (poziom " << state.level << ")";
+			}
+			std::cout << "\n";
 		}
-	} while (selectedNumbers.size() < TOURNAMENT_SIZE);
 
-	int bestSpecimen = selectedNumbers[0]; // najlepszy osobnik wybrany do turnieju - zwyciężca
+		if (state.level > finest) {
+			if (bestFitness == state.lastBestFitness || (LEVEL_GENERATIONS > 0 && i - state.levelStart + 1 >= LEVEL_GENERATIONS)) { // przejście na dokładniejszy poziom
+				state.level--;
+				state.levelStart = i + 1;
+				for (int s = 0; s < specimens.size(); s++) {
+					specimens.fitness(s) = specimenFitness(costTables[state.level], specimens, s);
+				}
+				state.lastBestFitness = 0;
+				if (verbose) {
+					std::cout << "Przejście na poziom rozdzielczości " << state.level << "\n";
+				}
+			} else {
+				state.lastBestFitness = bestFitness;
+			}
+		} else {
+			if (state.level == 0 && bestFitness == maxFitness) { // stop pętli po osiągnięciu najlepszego możliwego rezultatu (niemal nieprawdopodobne bez specjalnie przygotowanych kafelków)
+				if (verbose) {
+					std::cout << "\nOsiągnięto osobnika z maksymalną wartością fitness\n\n";
+				}
+				break;
+			}
+			if (STOP_OPTION == 1 && bestFitness == state.lastBestFitness) { // stop pętli po osiągnięciu dużej zbieżności
+				if (verbose) {
+					std::cout << "\nW dwóch pokoleniach pod rząd wystąpił ten sam najlepszy współczynnik fitness, program nie osiągnie już dużo lepszych rezultatów przez zbieżność osobników\n\n";
+				}
+				break;
+			}
+			state.lastBestFitness = bestFitness;
+		}
 
-	for (int i = 1; i < selectedNumbers.size(); i++) { // wybór zwyciężcy turnieju
-		if (specimens[selectedNumbers[i]].fitness > specimens[bestSpecimen].fitness) {
-			bestSpecimen = selectedNumbers[i];
+		state.generation++;
+		if (!checkpointPath.empty() && i % CHECKPOINT_EVERY == 0) { // stan po pokoleniu i - wznowienie zacznie od pokolenia i + 1
+			saveCheckpoint(checkpointPath, checkpointParameters(pool.size(), tiles.size(), finest), tablesChecksum, state, workers, specimens);
 		}
 	}
-
-	return bestSpecimen;
 }
 
-// Tworzy dwóch nowych osobników z pary rodziców metodą podwójnej selekcji turniejowej, krzyżowania i mutacji.
+// Parametry, od których zależy przebieg ewolucji - wznowienie z punktu kontrolnego wymaga tych samych. Ziarno nie jest wśród
+// nich, bo punkt kontrolny zawiera stan generatorów liczb losowych; liczba pokoleń i warunek zatrzymania mogą się zmienić.
 
-std::vector<specimen> reproduce(std::vector<specimen> &specimens, std::vector<cv::Mat> &tiles, cv::Mat pictureOryg) {
-	int mother = tournament(specimens); // wybierz matkę selekcją turniejową
-	int father;
+std::vector<int> checkpointParameters(int threads, int tilesCount, int finest) {
+	int values[] = {TILES_X, TILES_Y, tilesCount, POP_SIZE, TOURNAMENT_SIZE, PROB_CROSSING, PROB_MUTATION, threads, finest, LEVEL_GENERATIONS};
+	return std::vector<int>(values, values + sizeof(values) / sizeof(values[0]));
+}
 
-	std::vector<specimen> children; // tablica dzieci powstałych z krzyżowania
-	children.resize(2); // stwórz 2 nowe osobniki w tablicy
+// Przelicza fitness osobników populacji w pełnej rozdzielczości i zwraca numer najlepszego. Osobniki z ujemnym fitnessem są
+// pomijane. Bez tablicy pełnej rozdzielczości (finest > 0) dokładnie, z obrazu mozaiki, oceniane jest tylko kilku najlepszych
+// osobników według tablicy poziomu finest - pozostałe zachowują fitness z tego poziomu.
 
-	do { // wybierz ojca selekcją turniejową, ale innego osobnika niż matka
-		father = tournament(specimens);
-	} while (father == mother);
+int finalSpecimen(population &specimens, std::vector<std::vector<int> > &costTables, int finest, cv::Mat picture, std::vector<cv::Mat> &tiles, cv::Size tileSize) {
+	std::vector<int> candidates;
+	for (int s = 0; s < specimens.size(); s++) {
+		if (specimens.fitness(s) >= 0) {
+			specimens.fitness(s) = specimenFitness(costTables[finest], specimens, s); // wyspy mogły skończyć na różnych poziomach
+			candidates.push_back(s);
+		}
+	}
+	if (candidates.empty()) {
+		return 0;
+	}
 
-	if (rand() % 100 + 1 <= PROB_CROSSING) { // krzyżowanie z zadanym prawdopodobieństwem
-		std::vector<int> cuts; // miejsca cięć chromosomów
-		for (int i = 0; i < specimens[mother].v.size() / 5; i++) { // wylosuj miejsca cięć - ilość cięć = 1/5 dł. chromosomu
-			cuts.push_back(rand() % specimens[mother].v.size());
+	if (finest > 0) {
+		const int RESCORED = 10; // ilu najlepszych osobników oceniać z obrazu mozaiki
+		int count = std::min<int>(RESCORED, candidates.size());
+		std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(), [&](int a, int b) {
+			return specimens.fitness(a) > specimens.fitness(b);
+		});
+		candidates.resize(count);
+		cv::Mat grid = picture(cv::Rect(0, 0, tileSize.width * TILES_X, tileSize.height * TILES_Y));
+		for (int i = 0; i < count; i++) {
+			specimens.fitness(candidates[i]) = calculateFitness(grid, renderMosaic(specimens, candidates[i], tiles, tileSize));
 		}
-		cuts.push_back(specimens[mother].v.size()); // dodaj cięcie na końcu, aby zawsze tablica dziecka była uzupełniona do końca
-		std::sort(cuts.begin(), cuts.end()); // posortuj listę miejsc cięć
+	}
 
-		children[0].v.reserve(specimens[mother].v.size()); // zarezerwuj miejsce w tablicy, by uniknąć jej zwiększania i kopiowania w trakcie dodawania danych
-		children[1].v.reserve(specimens[mother].v.size());
+	int best = candidates[0];
+	for (int i = 1; i < candidates.size(); i++) {
+		if (specimens.fitness(candidates[i]) > specimens.fitness(best)) {
+			best = candidates[i];
+		}
+	}
+	return best;
+}
 
-		int last = 0; // miejsce poprzedniego cięcia, czyli odkąd zacząć doklejanie kolejnego fragmentu chromosomu
-		for (int i = 0; i < cuts.size(); i++) { // stwórz chromosomy dzieci krzyżując chromosomy rodziców
-			int parent1 = (i % 2 == 1) ? father : mother; // na zmianę bierz kawałek chromosomu ojca i matki
-			int parent2 = (i % 2 == 1) ? mother : father;
+// Model wyspowy: ISLANDS populacji ewoluuje w osobnych procesach (każdy z threads / ISLANDS wątkami), wymieniając co
+// MIGRATION_INTERVAL pokoleń najlepsze osobniki przez pamięć współdzieloną. Bieżący proces jest koordynatorem - raportuje
+// najlepszy fitness wszystkich wysp i po zakończeniu wysp zapisuje do best najlepszego osobnika z pokolenia zerowego (0)
+// oraz ostatniego osobnika każdej wyspy (1 + numer wyspy, fitness -1 gdy wyspa nie zakończyła pracy). Procesy wysp powstają
+// po zbudowaniu tablic kosztów, więc dzielą je z koordynatorem bez kopiowania.
+
+bool evolveIslands(std::vector<cv::Mat> &tiles, std::vector<std::vector<int> > &costTables, int finest, int threads, long long maxFitness,
+		const std::vector<int> &seedTiles, population &best) {
+	int genes = TILES_X * TILES_Y;
+	islandExchange exchange;
+	if (!exchange.create(ISLANDS, genes, MIGRANTS)) {
+		return false;
+	}
+	if (telemetry.isOpen()) {
+		std::cout << "Pomiary pokoleń (--telemetry) nie są zapisywane w trybie wysp\n";
+	}
 
-			std::copy(specimens[parent1].v.begin() + last, specimens[parent1].v.begin() + cuts[i], std::back_inserter(children[0].v)); // back_inserter potrzebny z powodu użycia reserve zamiast resize kilka linii wyżej
-			std::copy(specimens[parent1].r.begin() + last, specimens[parent1].r.begin() + cuts[i], std::back_inserter(children[0].r));
-			
-			std::copy(specimens[parent2].v.begin() + last, specimens[parent2].v.begin() + cuts[i], std::back_inserter(children[1].v));
-			std::copy(specimens[parent2].r.begin() + last, specimens[parent2].r.begin() + cuts[i], std::back_inserter(children[1].r));
-			
-			last = cuts[i];
+	std::cout << "Uruchamianie " << ISLANDS << " wysp po " << POP_SIZE << " osobników\n";
+	std::cout.flush(); // procesy potomne dziedziczą bufor wyjścia, więc musi być pusty
+
+	std::vector<pid_t> pids;
+	for (int island = 0; island < ISLANDS; island++) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			runIsland(island, exchange, tiles, costTables, finest, std::max(1, threads / ISLANDS), maxFitness, seedTiles);
+			std::cout.flush();
+			_exit(EXIT_SUCCESS); // bez destruktorów: wątki puli koordynatora nie istnieją w procesie potomnym
+		}
+		if (pid < 0) {
+			std::cout << "Błąd tworzenia procesu wyspy " << island << "\n";
+			break;
 		}
-	} else { // brak krzyżowania - potomkowie są tacy sami jak rodzice (chyba że wystąpi mutacja)
-		children[0].v = specimens[mother].v;
-		children[0].r = specimens[mother].r;
-		children[1].v = specimens[father].v;
-		children[1].r = specimens[father].r;
+		pids.push_back(pid);
 	}
 
-	for (int i = 0; i < children.size(); i++) { // akcje wykonywane na każdym dziecku
-		specimen * child = &children[i];
-
-		if (rand() % 100 + 1 <= PROB_MUTATION) { // mutacja z zadanym prawdopodobieństwem
-			for (int i = 0; i < child->v.size() / 100; i++) { // zamień 1/100 kafelków na losowe
-				child->v[rand() % child->v.size()] = rand() % tiles.size();
+	int running = pids.size();
+	long long reportedFitness = -1;
+	while (running > 0) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+		for (int i = 0; i < pids.size(); i++) {
+			int status;
+			if (pids[i] > 0 && waitpid(pids[i], &status, WNOHANG) == pids[i]) {
+				if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+					std::cout << "Proces wyspy " << i << " zakończył się błędem\n";
+				}
+				pids[i] = -1;
+				running--;
 			}
-			for (int i = 0; i < child->r.size() / 100; i++) { // zamień wartość odbicia lustrzanego u 1/100 kafelków na przeciwne
-				int j = rand() % child->r.size();
-				child->r[j] = !child->r[j];
+		}
+
+		long long bestFitness = 0, minGeneration = -1, maxGeneration = 0;
+		int bestIsland = 0;
+		for (int i = 0; i < ISLANDS; i++) {
+			islandStatus &status = exchange.status(i);
+			long long generation = status.generation.load(std::memory_order_relaxed), fitness = status.bestFitness.load(std::memory_order_relaxed);
+			minGeneration = minGeneration < 0 ? generation : std::min(minGeneration, generation);
+			maxGeneration = std::max(maxGeneration, generation);
+			if (fitness > bestFitness) {
+				bestFitness = fitness;
+				bestIsland = i;
 			}
 		}
+		if (bestFitness != reportedFitness) {
+			std::cout << "Pokolenia wysp: " << minGeneration << "-" << maxGeneration << "; Najlepszy fitness: " << bestFitness << " (wyspa " << bestIsland << ")\n";
+			reportedFitness = bestFitness;
+		}
+	}
 
-		child->m = cv::Mat(specimens[mother].m.rows, specimens[mother].m.cols, CV_8UC3);
-		for (int i = 0; i < child->v.size(); i++) { // stwórz matrycę obrazu na podstawie chromosomu
-			putTileOnMosaic(child->m, tiles.at(child->v[i]), i, child->r[i]);
+	population candidate; // osobnik odczytywany z kolejnych wysp
+	candidate.resize(1, genes);
+	best.resize(1 + ISLANDS, genes);
+	best.fitness(0) = -1;
+	bool found = false;
+	for (int i = 0; i < ISLANDS; i++) {
+		bool finished = exchange.status(i).finished.load(std::memory_order_acquire);
+		if (finished && exchange.readResult(i, 0, candidate, 0) && candidate.fitness(0) > best.fitness(0)) {
+			best.copySpecimen(0, candidate, 0);
+		}
+		best.fitness(1 + i) = -1;
+		if (finished && exchange.readResult(i, 1, best, 1 + i)) { // wyspy mogły skończyć na różnych poziomach - wybór wyniku przelicza fitness
+			found = true;
 		}
+	}
+	if (!found) {
+		std::cout << "Żadna wyspa nie zakończyła pracy\n";
+		return false;
+	}
+	return true;
+}
+
+// Przebieg jednej wyspy w procesie potomnym: własna populacja, pula wątków i generatory liczb losowych (ziarno SEED + numer wyspy).
+// Co MIGRATION_INTERVAL pokoleń wyspa publikuje najlepsze osobniki i przyjmuje migrantów od poprzedniej wyspy. Gdy seedTiles
+// nie jest pusty, WARM_START procent pokolenia zerowego wyspy powstaje z tego układu (seedPopulation).
 
-		child->fitness = calculateFitness(pictureOryg, child->m); // wylicz funkcję przystosowania dziecka
+void runIsland(int island, islandExchange &exchange, std::vector<cv::Mat> &tiles, std::vector<std::vector<int> > &costTables, int finest, int threads, long long maxFitness,
+		const std::vector<int> &seedTiles) {
+	ThreadPool pool(threads);
+	std::vector<gaWorker> workers;
+	initWorkers(workers, pool.size(), SEED + island);
+
+	population specimens;
+	initPopulation(specimens, costTables.back(), tiles.size(), workers[0].rng);
+	if (!seedTiles.empty()) {
+		seedPopulation(specimens, costTables.back(), tiles.size(), seedTiles, std::max(1, POP_SIZE * WARM_START / 100), workers[0].rng);
 	}
+	exchange.publishResult(island, 0, specimens, bestSpecimenIndex(specimens));
+
+	islandStatus &status = exchange.status(island);
+	unsigned long long received = 0; // ilu migrantów poprzedniej wyspy już sprawdzono
+	evolutionState state = {1, (int)costTables.size() - 1, 1, 0};
+	evolve(specimens, tiles, costTables, finest, pool, workers, maxFitness, false, state, "", [&](int generation, double, std::vector<int> &costTable) {
+		if (generation % MIGRATION_INTERVAL == 0) {
+			exchange.publish(island, specimens);
+			if (exchange.receive(island, specimens, received) > 0 && costTables.size() > 1) {
+				for (int s = 0; s < specimens.size(); s++) { // migranci mogą pochodzić z innego poziomu rozdzielczości
+					specimens.fitness(s) = specimenFitness(costTable, specimens, s);
+				}
+			}
+		}
+		status.generation.store(generation, std::memory_order_relaxed);
+		status.bestFitness.store(specimens.fitness(bestSpecimenIndex(specimens)), std::memory_order_relaxed);
+	});
 
-	return children;
+	exchange.publishResult(island, 1, specimens, bestSpecimenIndex(specimens));
 }
 
-// Tworzy nowe pokolenie.
+// Tryb serwera (server.h): --serve=ścieżka gniazda, --jobs=N wątków zadań (domyślnie 2), --queue=N miejsc w kolejce zadań
+// (domyślnie 16), --threads=N wątków puli wspólnej dla wszystkich zadań, --preload=ROZMIAR[,ROZMIAR...] - rozmiary kafelków
+// wczytywane do biblioteki od razu przy starcie (pozostałe przy pierwszym zadaniu, które ich potrzebuje).
+
+bool serve(options &opts, tileLibrary &library) {
+	bool valid = true;
+	int jobThreads = opts.getInt("jobs", 2, 1, 256, valid);
+	int queueCapacity = opts.getInt("queue", 16, 1, 1000000, valid);
+	int threads = opts.getInt("threads", 0, 0, 4096, valid);
+	if (!valid) {
+		return false;
+	}
 
-void nextGeneration(std::vector<specimen> &oldGeneration, std::vector<specimen> &newGeneration, std::vector<cv::Mat> &tiles, cv::Mat pictureOryg) {
-	std::vector<specimen> tempGeneration; // tymczasowa tablica nowych osobników, ponieważ oldGeneration i newGeneration może wskazywać na ten sam wektor
-	tempGeneration.reserve(POP_SIZE); // zarezerwuj miejsce w tablicy, by uniknąć jej zwiększania i kopiowania w trakcie dodawania osobników
+	std::istringstream preload(opts.get("preload", ""));
+	std::string item;
+	while (std::getline(preload, item, ',')) {
+		options size; // rozmiar w tej samej postaci co --tile
+		size.values["preload"] = item;
+		cv::Size tileSize = size.getSize("preload", cv::Size(0, 0), valid);
+		if (!valid) {
+			return false;
+		}
+		std::cout << "Kafelki " << tileSize.width << "x" << tileSize.height << ": " << library.get(tileSize).tiles.size() << "\n";
+	}
+
+	QUIET = true; // postęp pokoleń i statystyki wielu zadań zaśmiecałyby dziennik serwera
+	library.setVerbose(false); // tak samo postęp budowania biblioteki kafelków w wątkach zadań
+	ThreadPool pool(threads);
+	gridLock grids;
+	cv::Size defaultGrid(TILES_X, TILES_Y); // siatka zadań bez --grid
+	return runServer(opts.get("serve", ""), jobThreads, queueCapacity, [&](const options &job, std::string &result) {
+		return serveJob(job, library, pool, grids, defaultGrid, result);
+	});
+}
+
+// Zadanie serwera: jeden obraz i --output=plik wyniku. --algorithm=ga (domyślnie) tworzy mozaikę algorytmem genetycznym
+// z parametrami jak w trybie wsadowym (bez modelu wyspowego - serwer nie może tworzyć procesów), --algorithm=greedy dopasowaniem
+// z mozaika1 (-p piksel po pikselu). --grid, --tile i --render-tile jak w linii poleceń; plik TIFF zapisywany jest obok wyniku
+// (batch.h, largeMosaicPath).
+
+bool serveJob(const options &job, tileLibrary &library, ThreadPool &pool, gridLock &grids, cv::Size defaultGrid, std::string &result) {
+	bool valid = true;
+	cv::Size tileSize = job.getSize("tile", cv::Size(0, 0), valid);
+	cv::Size renderTile = job.getSize("render-tile", cv::Size(0, 0), valid);
+	cv::Size grid = job.getSize("grid", defaultGrid, valid);
+	std::string algorithm = job.get("algorithm", "ga");
+	std::string output = job.get("output", "");
+	if (!valid || (algorithm != "ga" && algorithm != "greedy") || job.inputs.size() != 1 || output.empty()) {
+		result = "Zadanie wymaga jednego obrazu, --output=plik, --algorithm=ga albo greedy i poprawnych --tile, --grid, --render-tile";
+		return false;
+	}
 
-	for (int i = 0; i < POP_SIZE / 2; i++) {
-		std::vector<specimen> children = reproduce(oldGeneration, tiles, pictureOryg); // stwórz 2 nowe osobniki
-		tempGeneration.insert(tempGeneration.end(), children.begin(), children.end()); // dopisz osobniki na końcu tablicy
+	cv::Mat picture = cv::imread(job.inputs[0], CV_LOAD_IMAGE_COLOR);
+	if (!picture.data) {
+		result = "Błąd odczytu obrazu " + job.inputs[0];
+		return false;
 	}
+	size_t slash = output.find_last_of('/');
+	std::string renderOutput = renderTile.area() == 0 ? "" : largeMosaicPath(output, slash == std::string::npos ? "." : output.substr(0, slash));
+
+	cv::Mat mosaic;
+	bool exclusive = algorithm == "ga"; // parametry algorytmu genetycznego są zmiennymi globalnymi
+	grids.acquire(grid, exclusive);
+	if (!exclusive) {
+		mosaic = createMosaic(picture, library, tileSize, job.has("p"), pool, renderTile, renderOutput, !QUIET);
+	} else {
+		options params = job;
+		if (readParameters(params, false) && ISLANDS == 1) {
+			RENDER_TILE = renderTile;
+			mosaic = evolveMosaic(picture, library, tileSize, pool, NULL, renderOutput, CHECKPOINT_DIR.empty() ? "" : outputPath(job.inputs[0], CHECKPOINT_DIR, "ckpt"));
+		} else if (ISLANDS > 1) {
+			std::cout << "Model wyspowy (--islands) nie jest dostępny w trybie serwera\n";
+		}
+	}
+	grids.release();
 
-	newGeneration = tempGeneration;
+	if (!mosaic.data) {
+		result = "Nie udało się utworzyć mozaiki (szczegóły w dzienniku serwera)";
+		return false;
+	}
+	if (!cv::imwrite(output, mosaic)) {
+		result = "Błąd zapisu " + output;
+		return false;
+	}
+	std::ostringstream out;
+	out << output << " " << mosaic.cols << "x" << mosaic.rows;
+	result = out.str();
+	return true;
 }
 
 // Pobiera parametr od użytkownika, kliknięcie enter pozostawia domyślną wartość parametru. Parametr musi być większy od 0.
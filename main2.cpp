@@ -6,13 +6,20 @@
 #include <dirent.h>
 #include <cmath>
 #include <time.h>
+#include <string>
+
+#include "batch.h"
+#include "greedy.h"
+#include "grid.h"
+#include "quadtree.h"
+#include "sad.h"
+#include "threadpool.h"
+#include "tiles.h"
+#include "video.h"
 
 #define WINDOW_1 "Obraz oryginalny"
 #define WINDOW_3 "Mozaika"
 
-const int TILES_X = 30; // ilość kafelków w poziomie
-const int TILES_Y = TILES_X; // ilość kafelków w pionie, musi być taka sama jak ilość kafelków w poziomie
-
 /*
  * Ten program:
  * 1. Wczytuje obrazki kafelków i wylicza średni kolor (RGB) każdego z nich
@@ -30,71 +37,102 @@ const int TILES_Y = TILES_X; // ilość kafelków w pionie, musi być taka sama
  *   i mamy taki sam dwukolorowy kafelek, to w algorytmie genetycznym ma on dużą szansę bycia dopasowanym na dane miejsce,
  *   podczas gdy w tutaj wstawiony zostanie kafelek, którego średni kolor to szary, czyli taki jak średni kolor obszaru, i to prawdopodobnie
  *   największa wada tego podejścia
+ *
+ * Uruchomienie z opcją -p (np. ./mozaika1 obraz.jpg -p) usuwa dwie ostatnie wady: kafelki porównywane są z obszarem piksel po pikselu
+ * (ta sama miara co fitness w algorytmie genetycznym), razem z ich odbiciami lustrzanymi. Żeby nie liczyć tego dla każdego kafelka,
+ * różnica sum kolorów obszaru i kafelka służy jako dolne ograniczenie różnicy pikseli - kafelki, których ograniczenie jest gorsze
+ * od najlepszego dotychczas wyniku, są pomijane, a liczenie różnicy pikseli przerywane jest, gdy tylko przekroczy najlepszy wynik.
+ *
+ * Z opcją --output=katalog program działa bez okienek i przetwarza wszystkie podane obrazy (pliki, katalogi, --list=plik),
+ * zapisując mozaiki w podanym katalogu - opis pozostałych parametrów w batch.h. W tym trybie --render-tile=SZEROKOŚĆxWYSOKOŚĆ
+ * zapisuje obok każdej mozaiki plik TIFF narysowany z oryginalnych plików kafelków w polach tego rozmiaru (render.h).
+ * Opcja --video traktuje obrazy (w kolejności nazw) jak klatki filmu i dobiera kafelki ponownie tylko w zmienionych polach
+ * (video.h); --threshold=N ustala próg zmiany średniego koloru pola, a --hysteresis=P przewagę nowego kafelka w procentach.
+ * Opcja --quadtree=N dzieli niejednolite pola siatki na mniejsze, do N poziomów (quadtree.h), a --detail=T ustala próg podziału.
  */
 
-void getTiles(std::vector<cv::Mat> &, cv::Size, const char*);
-int scalarDiff(cv::Scalar &, cv::Scalar &);
-
 int main(int argc, char* argv[]) {
 	srand(time(NULL));
 
-	if (argc < 2) { // czy podano argument przy uruchamianiu programu
-		std::cout << "Nie podano obrazu do przetworzenia\n";
+	options opts;
+	if (!parseOptions(argc, argv, opts)) {
 		return EXIT_FAILURE;
 	}
 
-	cv::Mat pictureOryg; // oryginalny wczytany obraz (format BGR)
-
-	char* filename = argv[1];
-	pictureOryg = cv::imread(filename, CV_LOAD_IMAGE_COLOR); // wczytaj podany obrazek
-
-	if (!pictureOryg.data) {
-		std::cout << "Błąd odczytu obrazu\n";
+	std::vector<std::string> inputs = expandInputs(opts);
+	if (inputs.empty()) { // czy podano argument przy uruchamianiu programu
+		std::cout << "Nie podano obrazu do przetworzenia\n";
 		return EXIT_FAILURE;
 	}
 
-	int width = pictureOryg.cols, height = pictureOryg.rows;
-	cv::Size tileSize(width / TILES_X, height / TILES_Y); // wymiary kafelek
-
-	std::vector<cv::Mat> tiles; // lista plików kafelków - obrazków tworzące mozaikę
-	getTiles(tiles, tileSize, "pictures"); // załaduj listę kafelków
-
-	if (tiles.size() < 100) {
-		std::cout << "W bibliotece obrazów (katalog ./pictures) musi być minimum 100 plików JPG\n";
+	bool valid = true;
+	bool pixelMode = opts.has("p"); // dopasowanie piksel po pikselu zamiast po średnim kolorze
+	cv::Size tileSize = opts.getSize("tile", cv::Size(0, 0), valid); // stały rozmiar kafelków, domyślnie wyliczany z rozmiaru obrazu
+	cv::Size renderTile = opts.getSize("render-tile", cv::Size(0, 0), valid); // rozmiar pola mozaiki w wysokiej rozdzielczości
+	cv::Size grid = opts.getSize("grid", cv::Size(TILES_X, TILES_Y), valid); // wymiary siatki: kolumny x wiersze
+	TILES_X = grid.width;
+	TILES_Y = grid.height;
+	int threshold = opts.getInt("threshold", VIDEO_THRESHOLD, 0, 255 * 3, valid); // próg zmiany pola w trybie --video
+	int hysteresis = opts.getInt("hysteresis", VIDEO_HYSTERESIS, 0, 1000, valid);
+	int quadtreeLevels = opts.getInt("quadtree", 1, 1, 6, valid); // poziomy podziału pól (1 - równa siatka)
+	int detail = opts.getInt("detail", QUADTREE_DETAIL, 0, 255, valid);
+	if (quadtreeLevels > 1 && (renderTile.area() > 0 || opts.has("video"))) {
+		std::cout << "Opcja --quadtree nie działa razem z --render-tile ani --video\n";
+		valid = false;
+	}
+	if (!valid) {
 		return EXIT_FAILURE;
 	}
 
-	std::vector<cv::Scalar> tilesAvgColor; // lista średnich kolorów kafelków, jej indeksy odpowiadają indeksom kafelków z wektora tiles
-	tilesAvgColor.reserve(tiles.size());
-
-	for (int i = 0; i < tiles.size(); i++) { // wylicz średni kolor dla każdego kafelka
-		tilesAvgColor.push_back(cv::mean(tiles[i]));
+	ThreadPool pool;
+	tileLibrary library("pictures", &pool); // kafelki wczytywane raz dla każdego rozmiaru, wspólne dla wszystkich obrazów
+
+	if (opts.has("output")) { // tryb wsadowy
+		std::string directory = opts.get("output", ".");
+		if (opts.has("video")) {
+			std::unique_ptr<frameMosaic> video; // tworzony przy pierwszej klatce, gdy znany jest rozmiar kafelków
+			int failures = runBatch(inputs, directory, opts.get("ext", "png"), [&](const batchItem &item) {
+				if (!video) {
+					cv::Size size = tileSize.area() > 0 ? tileSize : cv::Size(item.picture.cols / TILES_X, item.picture.rows / TILES_Y);
+					if (size.area() == 0) {
+						std::cout << "Obraz jest za mały dla siatki " << TILES_X << "x" << TILES_Y << " kafelków\n";
+						return cv::Mat();
+					}
+					tileSet &set = library.get(size);
+					if (set.tiles.size() < 100) {
+						std::cout << "W bibliotece obrazów (katalog ./pictures) musi być minimum 100 plików JPG\n";
+						return cv::Mat();
+					}
+					video.reset(new frameMosaic(set, size, pixelMode, threshold, hysteresis, pool));
+				}
+				return video->next(item.picture);
+			});
+			if (video) {
+				video->printSummary();
+			}
+			return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+		int failures = runBatch(inputs, directory, opts.get("ext", "png"), [&](const batchItem &item) {
+			if (quadtreeLevels > 1) {
+				return quadtreeMosaic(item.picture, library, tileSize, pixelMode, quadtreeLevels, detail, pool);
+			}
+			return createMosaic(item.picture, library, tileSize, pixelMode, pool, renderTile, renderTile.area() > 0 ? largeMosaicPath(item.path, directory) : "");
+		});
+		return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 	}
 
-	cv::Mat pictureMosaic;
-	cv::resize(pictureOryg, pictureMosaic, cv::Size(tileSize.width * TILES_X, tileSize.height * TILES_Y)); // skopiowanie obrazka do nowej matrycy, w razie potrzeby nieco zmniejszonego do wymiaru pełnej wielokrotności kafelków
-
-	for (int i = 0; i < TILES_X * TILES_Y; i++) { // nałóż kolejne kafelki
-		int posX = (i % TILES_Y) * tileSize.width;
-		int posY = (i / TILES_X) * tileSize.height;
-
-		cv::Rect roi(posX, posY, tileSize.width, tileSize.height);
-		cv::Mat tilePlace = pictureMosaic(roi); // obszar mozaiki, na który ma być nałożony kafelek
-
-		cv::Scalar targetAvgColor = cv::mean(tilePlace); // średni kolor obszaru, na który ma być nałożony kafelek
-
-		int bestTileNumber = 0;
-		int bestDiff = scalarDiff(targetAvgColor, tilesAvgColor[0]);
+	cv::Mat pictureOryg; // oryginalny wczytany obraz (format BGR)
+	pictureOryg = cv::imread(inputs[0], CV_LOAD_IMAGE_COLOR); // wczytaj podany obrazek
 
-		for (int j = 1; j < tiles.size(); j++) { // poszukiwanie najlepszego kafelka (najmniej różniącego się od docelowego obszaru)
-			int diff = scalarDiff(targetAvgColor, tilesAvgColor[j]);
-			if (diff < bestDiff) {
-				bestDiff = diff;
-				bestTileNumber = j;
-			}
-		}
+	if (!pictureOryg.data) {
+		std::cout << "Błąd odczytu obrazu\n";
+		return EXIT_FAILURE;
+	}
 
-		tiles[bestTileNumber].copyTo(tilePlace); // nałóż wybrany kafelek
+	cv::Mat pictureMosaic = quadtreeLevels > 1 ? quadtreeMosaic(pictureOryg, library, tileSize, pixelMode, quadtreeLevels, detail, pool)
+			: createMosaic(pictureOryg, library, tileSize, pixelMode, pool);
+	if (!pictureMosaic.data) {
+		return EXIT_FAILURE;
 	}
 
 	cv::namedWindow(WINDOW_1, CV_WINDOW_KEEPRATIO); // okno oryginalnego obrazu
@@ -112,38 +150,3 @@ int main(int argc, char* argv[]) {
 
 	return EXIT_SUCCESS;
 }
-
-// Tworzy tablicę kafelków określonego rozmiaru na podstawie obrazów z podanego katalogu.
-
-void getTiles(std::vector<cv::Mat> &tiles, cv::Size tileSize, const char* directory) {
-	DIR *dir;
-	struct dirent *ent;
-
-	if ((dir = opendir(directory)) != NULL) {
-		while ((ent = readdir(dir)) != NULL) {
-			std::string fn = ent->d_name; // pobierz nazwę pliku
-			if (fn.substr(fn.find_last_of(".") + 1) == "jpg") { // czy to plik .jpg
-				fn = "pictures/" + fn;
-
-				cv::Mat tile = cv::imread(fn, CV_LOAD_IMAGE_COLOR);
-				cv::resize(tile, tile, tileSize);
-				tiles.push_back(tile); // dodaj do tablicy kafelków
-			}
-		}
-		closedir(dir);
-	} else {
-		std::cout << "Błąd odczytu biblioteki obrazów\n";
-	}
-}
-
-// Oblicza różnicę między scalarami - sumę różnic wartości RGB
-
-int scalarDiff(cv::Scalar &s1, cv::Scalar &s2) {
-	int diff = 0;
-
-	for (int i = 0; i < 3; i++) {
-		diff += std::abs(s1[i] - s2[i]);
-	}
-
-	return diff;
-}
@@ -0,0 +1,174 @@
+#ifndef MOZAIKA_QUADTREE_H
+#define MOZAIKA_QUADTREE_H
+
+#include <cv.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "colorindex.h"
+#include "greedy.h"
+#include "grid.h"
+#include "sad.h"
+#include "threadpool.h"
+#include "tilecopy.h"
+#include "tiles.h"
+
+/*
+ * Mozaika o zmiennym rozmiarze pól (program main2, opcja --quadtree=N): każde pole siatki TILES_X x TILES_Y jest dzielone
+ * na cztery, a te dalej, aż do N poziomów (pola najmniejszego poziomu są 2^(N-1) razy mniejsze od pól siatki), ale tylko tam,
+ * gdzie obraz jest niejednolity - odchylenie standardowe kolorów pola (średnie z kanałów B, G, R) przekracza próg --detail.
+ * Na jednolitych obszarach (niebo, ściana) zostają duże kafelki, a małe trafiają tylko w szczegóły, więc pól do dopasowania
+ * jest kilka razy mniej niż w równej siatce najmniejszych kafelków.
+ *
+ * Średni kolor i wariancja dowolnego prostokąta liczone są w stałym czasie z obrazów całkowych (cv::integral) sum i sum
+ * kwadratów. Kafelki każdego poziomu pochodzą z biblioteki kafelków w rozmiarze pól tego poziomu; brakujące rozmiary
+ * wszystkich poziomów wczytywane są razem, jednym przejściem po plikach i jednym zapisem pamięci podręcznej.
+ */
+
+const int QUADTREE_DETAIL = 12; // domyślny próg odchylenia standardowego kolorów, powyżej którego pole jest dzielone
+
+struct quadCell { // liść drzewa: prostokąt obrazu i jego poziom (0 - pole siatki)
+	cv::Rect rect;
+	int level;
+	cv::Scalar mean;
+};
+
+// Sumy kanałów B, G, R prostokąta rect z obrazu całkowego (CV_64FC3, o jeden wiersz i kolumnę większego od obrazu).
+
+inline cv::Scalar integralSum(const cv::Mat &integralImage, const cv::Rect &rect) {
+	const double *top = integralImage.ptr<double>(rect.y), *bottom = integralImage.ptr<double>(rect.y + rect.height);
+	int left = rect.x * 3, right = (rect.x + rect.width) * 3;
+	cv::Scalar sum;
+	for (int c = 0; c < 3; c++) {
+		sum[c] = bottom[right + c] - bottom[left + c] - top[right + c] + top[left + c];
+	}
+	return sum;
+}
+
+// Dzieli obraz picture (pola siatki rozmiaru cellSize, podzielnego przez 2^(levels-1)) na liście drzewa, kolejno pole po polu
+// siatki, a w nim w kolejności Z (lewy górny, prawy górny, lewy dolny, prawy dolny).
+
+inline void buildQuadtree(const cv::Mat &picture, cv::Size cellSize, int levels, double detail, ThreadPool &pool, std::vector<quadCell> &cells) {
+	cv::Mat sum, squares;
+	cv::integral(picture, sum, squares, CV_64F);
+
+	std::vector<std::vector<quadCell> > parts(TILES_X * TILES_Y); // liście każdego pola siatki
+	pool.parallelFor(TILES_X * TILES_Y, [&](int i, int) {
+		std::vector<quadCell> &part = parts[i];
+		std::vector<quadCell> stack(1);
+		stack[0].rect = cv::Rect((i % TILES_X) * cellSize.width, (i / TILES_X) * cellSize.height, cellSize.width, cellSize.height);
+		stack[0].level = 0;
+		while (!stack.empty()) {
+			quadCell cell = stack.back();
+			stack.pop_back();
+
+			double area = (double)cell.rect.width * cell.rect.height;
+			cv::Scalar s = integralSum(sum, cell.rect), q = integralSum(squares, cell.rect);
+			double variance = 0; // suma wariancji kanałów
+			for (int c = 0; c < 3; c++) {
+				cell.mean[c] = s[c] / area;
+				variance += q[c] / area - cell.mean[c] * cell.mean[c];
+			}
+
+			if (cell.level == levels - 1 || std::sqrt(std::max(0.0, variance) / 3) <= detail) {
+				part.push_back(cell);
+				continue;
+			}
+
+			int w = cell.rect.width / 2, h = cell.rect.height / 2;
+			for (int k = 3; k >= 0; k--) { // na stos od końca, żeby liście wychodziły w kolejności Z
+				quadCell child;
+				child.rect = cv::Rect(cell.rect.x + (k % 2) * w, cell.rect.y + (k / 2) * h, w, h);
+				child.level = cell.level + 1;
+				stack.push_back(child);
+			}
+		}
+	});
+
+	cells.clear();
+	for (int i = 0; i < parts.size(); i++) {
+		cells.insert(cells.end(), parts[i].begin(), parts[i].end());
+	}
+}
+
+// Tworzy mozaikę o zmiennym rozmiarze pól (levels poziomów, próg odchylenia standardowego detail). Rozmiar pól siatki wynika
+// z tileSize albo z rozmiaru obrazu i jest zaokrąglany w dół do wielokrotności 2^(levels-1). Kafelki dobierane są po średnim
+// kolorze albo, gdy pixelMode, piksel po pikselu (pixelMatcher). Zwraca pustą macierz, gdy obraz jest za mały albo kafelków
+// któregoś rozmiaru jest za mało.
+
+cv::Mat quadtreeMosaic(cv::Mat pictureOryg, tileLibrary &library, cv::Size tileSize, bool pixelMode, int levels, double detail, ThreadPool &pool) {
+	int step = 1 << (levels - 1); // ile razy najmniejsze pola są mniejsze od pól siatki
+	if (tileSize.area() == 0) {
+		tileSize = cv::Size(pictureOryg.cols / TILES_X, pictureOryg.rows / TILES_Y);
+	}
+	tileSize = cv::Size(tileSize.width / step * step, tileSize.height / step * step);
+	if (tileSize.area() == 0) {
+		std::cout << "Obraz jest za mały dla siatki " << TILES_X << "x" << TILES_Y << " kafelków podzielonych na " << levels << " poziomów\n";
+		return cv::Mat();
+	}
+
+	std::vector<cv::Size> sizes(levels); // rozmiary pól każdego poziomu, wczytywane z biblioteki razem
+	for (int l = 0; l < levels; l++) {
+		sizes[l] = cv::Size(tileSize.width >> l, tileSize.height >> l);
+	}
+	std::vector<tileSet *> sets = library.get(sizes); // kafelki w rozmiarze pól każdego poziomu
+	std::vector<std::unique_ptr<colorIndex> > indexes(levels);
+	std::vector<std::unique_ptr<pixelMatcher> > matchers(levels);
+	for (int l = 0; l < levels; l++) {
+		if (sets[l]->tiles.size() < 100) {
+			std::cout << "W bibliotece obrazów (katalog ./pictures) musi być minimum 100 plików JPG\n";
+			return cv::Mat();
+		}
+		if (pixelMode) {
+			matchers[l].reset(new pixelMatcher(sets[l]->tiles, pool.size()));
+		} else {
+			indexes[l].reset(new colorIndex(sets[l]->avgColors));
+		}
+	}
+
+	cv::Mat pictureTarget;
+	cv::resize(pictureOryg, pictureTarget, cv::Size(tileSize.width * TILES_X, tileSize.height * TILES_Y));
+	cv::Mat pictureMosaic(pictureTarget.size(), CV_8UC3);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<quadCell> cells;
+	buildQuadtree(pictureTarget, tileSize, levels, detail, pool, cells);
+
+	std::vector<int> perLevel(levels, 0);
+	for (int i = 0; i < cells.size(); i++) {
+		perLevel[cells[i].level]++;
+	}
+
+	pool.parallelFor(cells.size(), [&](int i, int worker) {
+		const quadCell &cell = cells[i];
+		int tile;
+		bool reflect = false;
+		if (pixelMode) {
+			unsigned long long sad;
+			long long computed = 0;
+			tile = matchers[cell.level]->match(pictureTarget(cell.rect), worker, reflect, sad, computed);
+		} else {
+			tile = indexes[cell.level]->nearest(cell.mean);
+		}
+		cv::Mat place = pictureMosaic(cell.rect);
+		copyTileFor(cell.rect.width)(sets[cell.level]->tiles[tile], place, reflect);
+	});
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout << "Pola mozaiki: " << cells.size() << " zamiast " << (long long)TILES_X * TILES_Y * step * step << " pól "
+			<< (tileSize.width / step) << "x" << (tileSize.height / step) << " (poziomy:";
+	for (int l = 0; l < levels; l++) {
+		std::cout << " " << perLevel[l];
+	}
+	std::cout << "), podział i dopasowanie w " << seconds << " s\n";
+	std::cout << "Fitness mozaiki: " << calculateFitness(pictureTarget, pictureMosaic)
+			<< " (najlepszy możliwy: " << (long long)pictureMosaic.rows * pictureMosaic.cols * 255 * 3 << ")\n";
+
+	return pictureMosaic;
+}
+
+#endif
@@ -0,0 +1,246 @@
+#ifndef MOZAIKA_RENDER_H
+#define MOZAIKA_RENDER_H
+
+#include <cv.h>
+#include <highgui.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "batch.h"
+#include "grid.h"
+#include "threadpool.h"
+#include "tilecopy.h"
+#include "tiles.h"
+
+/*
+ * Mozaika w wysokiej rozdzielczości do druku: dopasowanie kafelków odbywa się na małych kafelkach z biblioteki, a wynik
+ * rysowany jest z oryginalnych plików z katalogu pictures, przeskalowanych do dowolnego rozmiaru pola (np. 200x200 pikseli).
+ * Taki obraz może mieć kilka gigapikseli, więc nigdy nie jest trzymany w pamięci w całości - powstaje pas po pasie (jeden
+ * wiersz pól siatki) i jest od razu dopisywany do pliku BigTIFF (nieskompresowany, RGB, jeden pas TIFF na wiersz pól).
+ *
+ * Pasy składa osobny wątek: kafelki potrzebne w pasie dekodowane są równolegle w puli wątków (każdy plik raz na pas, kafelki
+ * z poprzedniego pasa używane są ponownie), a gotowe pasy czekają w kolejce o pojemności RENDER_PREFETCH, gdy bieżący wątek
+ * zapisuje wcześniejszy pas. W pamięci jest więc najwyżej RENDER_PREFETCH + 2 pasów.
+ */
+
+const int RENDER_PREFETCH = 2; // ile gotowych pasów może czekać na zapis
+
+// Zapis obrazu RGB do pliku BigTIFF pasami, bez trzymania całego obrazu w pamięci. Katalog IFD zapisywany jest na końcu
+// pliku przez close(), gdy znane są już położenia wszystkich pasów.
+
+class bigTiffWriter {
+public:
+	bigTiffWriter() : file(NULL), width(0), height(0), rowsPerStrip(0), rowsWritten(0) {}
+
+	~bigTiffWriter() {
+		if (file != NULL) {
+			fclose(file);
+		}
+	}
+
+	bool open(const std::string &path, int imageWidth, int imageHeight, int stripRows) {
+		file = fopen(path.c_str(), "wb");
+		if (file == NULL) {
+			return false;
+		}
+		width = imageWidth;
+		height = imageHeight;
+		rowsPerStrip = stripRows;
+		rowsWritten = 0;
+		row.resize((size_t)width * 3);
+
+		const unsigned char header[16] = {'I', 'I', 43, 0, 8, 0, 0, 0}; // little endian, BigTIFF, 8-bajtowe przesunięcia; IFD uzupełniane w close()
+		return fwrite(header, 1, sizeof(header), file) == sizeof(header);
+	}
+
+	// Dopisuje kolejny pas obrazu (BGR, szerokość obrazu, rowsPerStrip wierszy - ostatni pas może być niższy).
+
+	bool writeStrip(const cv::Mat &strip) {
+		offsets.push_back(ftello(file));
+		counts.push_back((uint64_t)strip.rows * width * 3);
+		for (int i = 0; i < strip.rows; i++) {
+			const unsigned char *src = strip.ptr(i);
+			for (int j = 0; j < width; j++) { // TIFF zapisuje kolory w kolejności RGB
+				row[3 * j] = src[3 * j + 2];
+				row[3 * j + 1] = src[3 * j + 1];
+				row[3 * j + 2] = src[3 * j];
+			}
+			if (fwrite(row.data(), 1, row.size(), file) != row.size()) {
+				return false;
+			}
+		}
+		rowsWritten += strip.rows;
+		return true;
+	}
+
+	// Zapisuje katalog IFD i zamyka plik. Zwraca false przy błędzie zapisu albo gdy zapisano inną liczbę wierszy niż zapowiedziano.
+
+	bool close() {
+		if (file == NULL) {
+			return false;
+		}
+		bool ok = rowsWritten == height;
+
+		uint64_t stripOffsets = writeArray(offsets), stripCounts = writeArray(counts);
+		uint64_t ifd = ftello(file);
+
+		std::vector<unsigned char> entries;
+		addEntry(entries, 256, 4, 1, width); // ImageWidth
+		addEntry(entries, 257, 4, 1, height); // ImageLength
+		addEntry(entries, 258, 3, 3, 8 | (8ULL << 16) | (8ULL << 32)); // BitsPerSample 8, 8, 8
+		addEntry(entries, 259, 3, 1, 1); // Compression: brak
+		addEntry(entries, 262, 3, 1, 2); // PhotometricInterpretation: RGB
+		addEntry(entries, 273, 16, offsets.size(), offsets.size() == 1 ? offsets[0] : stripOffsets); // StripOffsets
+		addEntry(entries, 277, 3, 1, 3); // SamplesPerPixel
+		addEntry(entries, 278, 4, 1, rowsPerStrip); // RowsPerStrip
+		addEntry(entries, 279, 16, counts.size(), counts.size() == 1 ? counts[0] : stripCounts); // StripByteCounts
+		addEntry(entries, 284, 3, 1, 1); // PlanarConfiguration: piksele RGB razem
+
+		uint64_t entryCount = entries.size() / 20, next = 0;
+		ok = ok && fwrite(&entryCount, 8, 1, file) == 1 && fwrite(entries.data(), 1, entries.size(), file) == entries.size()
+				&& fwrite(&next, 8, 1, file) == 1;
+		ok = ok && fseeko(file, 8, SEEK_SET) == 0 && fwrite(&ifd, 8, 1, file) == 1;
+		ok = fclose(file) == 0 && ok;
+		file = NULL;
+		return ok;
+	}
+
+private:
+	// Zapisuje tablicę wartości 64-bitowych (potrzebną, gdy pasów jest więcej niż jeden) i zwraca jej położenie w pliku.
+
+	uint64_t writeArray(const std::vector<uint64_t> &values) {
+		uint64_t offset = ftello(file);
+		if (values.size() > 1) {
+			fwrite(values.data(), 8, values.size(), file);
+		}
+		return offset;
+	}
+
+	// Wpis IFD: znacznik, typ (3 - SHORT, 4 - LONG, 16 - LONG8), liczba wartości i wartość (mieszcząca się w 8 bajtach) albo przesunięcie.
+
+	static void addEntry(std::vector<unsigned char> &entries, uint16_t tag, uint16_t type, uint64_t count, uint64_t value) {
+		unsigned char entry[20];
+		memcpy(entry, &tag, 2);
+		memcpy(entry + 2, &type, 2);
+		memcpy(entry + 4, &count, 8);
+		memcpy(entry + 12, &value, 8);
+		entries.insert(entries.end(), entry, entry + 20);
+	}
+
+	FILE *file;
+	int width, height, rowsPerStrip, rowsWritten;
+	std::vector<unsigned char> row; // wiersz po zamianie BGR na RGB
+	std::vector<uint64_t> offsets, counts; // położenie i rozmiar kolejnych pasów
+};
+
+// Dekoduje plik źródłowy kafelka i skaluje go do rozmiaru pola, korzystając z dekodowania w zmniejszonej rozdzielczości,
+// gdy plik jest dużo większy od pola. Zwraca pustą macierz, gdy pliku nie da się odczytać.
+
+inline cv::Mat loadRenderTile(const std::string &path, cv::Size cellSize) {
+	cv::Size pictureSize;
+	int flag = jpegSize(path, pictureSize) ? reducedReadFlag(pictureSize, std::vector<cv::Size>(1, cellSize)) : CV_LOAD_IMAGE_COLOR;
+	cv::Mat picture = cv::imread(path, flag);
+	if (!picture.data) {
+		return cv::Mat();
+	}
+
+	cv::Mat tile;
+	cv::resize(picture, tile, cellSize, 0, 0, picture.cols > cellSize.width ? cv::INTER_AREA : cv::INTER_LINEAR);
+	return tile;
+}
+
+// Rysuje mozaikę TILES_X x TILES_Y pól o rozmiarze cellSize do pliku BigTIFF. cellTiles i cellReflect - kafelek i odbicie
+// każdego pola (kolejno wierszami), sourcePaths - plik źródłowy każdego kafelka (tileSet::sourcePaths). Podsumowanie
+// zapisu wypisywane jest tylko, gdy verbose; błędy zawsze.
+
+inline bool renderLargeMosaic(const std::string &path, const std::vector<int> &cellTiles, const std::vector<bool> &cellReflect,
+		const std::vector<std::string> &sourcePaths, cv::Size cellSize, ThreadPool &pool, bool verbose = true) {
+	int width = cellSize.width * TILES_X, height = cellSize.height * TILES_Y;
+	bigTiffWriter writer;
+	if (!writer.open(path, width, height, cellSize.height)) {
+		std::cout << "Błąd zapisu " << path << "\n";
+		return false;
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	blockingQueue<cv::Mat> strips(RENDER_PREFETCH);
+	copyTileFunction copyTile = copyTileFor(cellSize.width);
+	int missing = 0; // pola, których kafelka nie udało się wczytać (zostają czarne)
+
+	std::thread composer([&] {
+		std::map<int, cv::Mat> previous; // kafelki poprzedniego pasa - sąsiednie pasy często używają tych samych kafelków
+		for (int y = 0; y < TILES_Y; y++) {
+			std::map<int, cv::Mat> current;
+			std::vector<int> needed; // kafelki pasa, których nie było w poprzednim pasie
+			for (int x = 0; x < TILES_X; x++) {
+				int t = cellTiles[y * TILES_X + x];
+				if (current.count(t) == 0) {
+					std::map<int, cv::Mat>::iterator it = previous.find(t);
+					current[t] = it != previous.end() ? it->second : cv::Mat();
+					if (it == previous.end()) {
+						needed.push_back(t);
+					}
+				}
+			}
+
+			std::vector<cv::Mat> loaded(needed.size());
+			pool.parallelFor(needed.size(), [&](int i, int) {
+				loaded[i] = loadRenderTile(sourcePaths[needed[i]], cellSize);
+			});
+			for (int i = 0; i < needed.size(); i++) {
+				current[needed[i]] = loaded[i];
+			}
+
+			cv::Mat strip(cellSize.height, width, CV_8UC3, cv::Scalar(0, 0, 0));
+			pool.parallelFor(TILES_X, [&](int x, int) {
+				int cell = y * TILES_X + x;
+				const cv::Mat &tile = current.find(cellTiles[cell])->second;
+				if (!tile.data) {
+					return;
+				}
+				cv::Mat place = strip(cv::Rect(x * cellSize.width, 0, cellSize.width, cellSize.height));
+				copyTile(tile, place, cellReflect[cell]);
+			});
+			for (int x = 0; x < TILES_X; x++) {
+				missing += !current.find(cellTiles[y * TILES_X + x])->second.data;
+			}
+
+			strips.push(strip);
+			previous.swap(current);
+		}
+		strips.close();
+	});
+
+	bool ok = true;
+	cv::Mat strip;
+	while (strips.pop(strip)) {
+		ok = ok && writer.writeStrip(strip);
+	}
+	composer.join();
+	ok = writer.close() && ok;
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if (!ok) {
+		std::cout << "Błąd zapisu " << path << "\n";
+		return false;
+	}
+	if (!verbose) {
+		return true;
+	}
+	std::cout << "Zapisano " << path << " (" << width << "x" << height << ", " << (double)width * height / 1e6 << " Mpx w " << seconds << " s";
+	if (missing > 0) {
+		std::cout << ", pól bez kafelka: " << missing;
+	}
+	std::cout << ")\n";
+	return true;
+}
+
+#endif
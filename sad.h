@@ -0,0 +1,266 @@
+#ifndef MOZAIKA_SAD_H
+#define MOZAIKA_SAD_H
+
+#include <cv.h>
+#include <cstdlib>
+#include <cstddef>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MOZAIKA_SAD_X86
+#include <immintrin.h>
+#endif
+
+/*
+ * Suma wartości bezwzględnych różnic (SAD) dwóch ciągów bajtów - podstawa funkcji przystosowania.
+ * Wersja skalarna jest wzorcem, wersje SSE2 i AVX2 muszą dawać dokładnie ten sam wynik.
+ * Wersja używana przez sadBytes() wybierana jest raz, przy pierwszym wywołaniu, na podstawie możliwości procesora.
+ * Sumy są 64-bitowe, więc nie przepełniają się nawet dla obrazów wielu gigapikseli.
+ */
+
+typedef unsigned long long (*sadFunction)(const unsigned char *, const unsigned char *, size_t);
+
+inline unsigned long long sadScalar(const unsigned char *a, const unsigned char *b, size_t n) {
+	unsigned long long sum = 0;
+	for (size_t i = 0; i < n; i++) {
+		sum += std::abs(a[i] - b[i]);
+	}
+	return sum;
+}
+
+#ifdef MOZAIKA_SAD_X86
+
+__attribute__((target("sse2")))
+inline unsigned long long sadSse2(const unsigned char *a, const unsigned char *b, size_t n) {
+	__m128i acc = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) { // psadbw daje dwie 16-bitowe sumy w 64-bitowych połówkach
+		__m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+		__m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+		acc = _mm_add_epi64(acc, _mm_sad_epu8(x, y));
+	}
+	unsigned long long parts[2];
+	_mm_storeu_si128((__m128i *)parts, acc);
+	return parts[0] + parts[1] + sadScalar(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2")))
+inline unsigned long long sadAvx2(const unsigned char *a, const unsigned char *b, size_t n) {
+	__m256i acc = _mm256_setzero_si256();
+	size_t i = 0;
+	for (; i + 32 <= n; i += 32) {
+		__m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+		__m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+		acc = _mm256_add_epi64(acc, _mm256_sad_epu8(x, y));
+	}
+	unsigned long long parts[4];
+	_mm256_storeu_si256((__m256i *)parts, acc);
+	return parts[0] + parts[1] + parts[2] + parts[3] + sadSse2(a + i, b + i, n - i);
+}
+
+#endif
+
+// Wybiera najszybszą wersję dostępną na tym procesorze.
+
+inline sadFunction chooseSad() {
+#ifdef MOZAIKA_SAD_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		return sadAvx2;
+	}
+	if (__builtin_cpu_supports("sse2")) {
+		return sadSse2;
+	}
+#endif
+	return sadScalar;
+}
+
+inline unsigned long long sadBytes(const unsigned char *a, const unsigned char *b, size_t n) {
+	static const sadFunction f = chooseSad();
+	return f(a, b, n);
+}
+
+// SAD dwóch macierzy CV_8UC3 po obszarze o wymiarach matB. Wiersze przetwarzane są jako ciągłe bloki bajtów,
+// a gdy obie macierze są ciągłe i tej samej szerokości - jako jeden blok.
+
+inline unsigned long long sadMat(const cv::Mat &matA, const cv::Mat &matB) {
+	size_t rowBytes = (size_t)matB.cols * 3;
+
+	if (matA.isContinuous() && matB.isContinuous() && matA.cols == matB.cols) {
+		return sadBytes(matA.ptr(0), matB.ptr(0), rowBytes * matB.rows);
+	}
+
+	unsigned long long sum = 0;
+	for (int i = 0; i < matB.rows; i++) {
+		sum += sadBytes(matA.ptr(i), matB.ptr(i), rowBytes);
+	}
+	return sum;
+}
+
+// SAD dwóch macierzy CV_8UC3 z przerwaniem: liczenie kończy się po pierwszym wierszu, po którym suma przekroczy limit.
+// Wynik jest dokładny, gdy nie przekracza limitu; w przeciwnym razie jest tylko pewną wartością większą od limitu.
+
+inline unsigned long long sadMatBounded(const cv::Mat &matA, const cv::Mat &matB, unsigned long long limit) {
+	size_t rowBytes = (size_t)matB.cols * 3;
+
+	unsigned long long sum = 0;
+	for (int i = 0; i < matB.rows && sum <= limit; i++) {
+		sum += sadBytes(matA.ptr(i), matB.ptr(i), rowBytes);
+	}
+	return sum;
+}
+
+// Wylicza przystosowanie danej mozaiki - jak bardzo jej kolory są podobne do oryginalnych. Czym więcej tym lepiej.
+// Maksimum (obrazy identyczne) = ilość pikseli * 255 * 3.
+
+inline long long calculateFitness(cv::Mat matA, cv::Mat matB) {
+	return (long long)matB.rows * matB.cols * 255 * 3 - (long long)sadMat(matA, matB);
+}
+
+// SAD kafelka o szerokości znanej w czasie kompilacji (W pikseli) i obszaru obrazu tej samej wielkości. Stała długość wiersza
+// pozwala w pełni rozwinąć pętlę wiersza, a sumy częściowe zbierane są przez wszystkie wiersze i dodawane raz na końcu,
+// zamiast wywoływać sadBytes() osobno dla każdego wiersza.
+
+typedef unsigned long long (*sadTileFunction)(const cv::Mat &, const cv::Mat &);
+
+template <int W>
+inline unsigned long long sadTileScalar(const cv::Mat &cell, const cv::Mat &tile) {
+	unsigned long long sum = 0;
+	for (int i = 0; i < tile.rows; i++) {
+		const unsigned char *a = cell.ptr(i), *b = tile.ptr(i);
+		unsigned int row = 0; // W * 3 * 255 mieści się w 32 bitach
+		for (int j = 0; j < W * 3; j++) {
+			row += std::abs(a[j] - b[j]);
+		}
+		sum += row;
+	}
+	return sum;
+}
+
+#ifdef MOZAIKA_SAD_X86
+
+template <int W>
+__attribute__((target("sse2")))
+inline unsigned long long sadTileSse2(const cv::Mat &cell, const cv::Mat &tile) {
+	const int BYTES = W * 3;
+	const int END16 = BYTES / 16 * 16; // wiersz dzielony na bloki 16, 8 i 4 bajtów znane w czasie kompilacji, reszta bajt po bajcie
+	const int END8 = BYTES - END16 >= 8 ? END16 + 8 : END16;
+	const int END4 = BYTES - END8 >= 4 ? END8 + 4 : END8;
+	__m128i acc = _mm_setzero_si128();
+	unsigned long long tail = 0;
+	for (int i = 0; i < tile.rows; i++) {
+		const unsigned char *a = cell.ptr(i), *b = tile.ptr(i);
+		for (int j = 0; j < END16; j += 16) {
+			acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i *)(a + j)), _mm_loadu_si128((const __m128i *)(b + j))));
+		}
+		if (END8 > END16) { // 8 bajtów w dolnej połowie rejestru, górna wyzerowana
+			acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadl_epi64((const __m128i *)(a + END16)), _mm_loadl_epi64((const __m128i *)(b + END16))));
+		}
+		if (END4 > END8) {
+			int x, y;
+			memcpy(&x, a + END8, 4);
+			memcpy(&y, b + END8, 4);
+			acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_cvtsi32_si128(x), _mm_cvtsi32_si128(y)));
+		}
+		for (int j = END4; j < BYTES; j++) {
+			tail += std::abs(a[j] - b[j]);
+		}
+	}
+	unsigned long long parts[2];
+	_mm_storeu_si128((__m128i *)parts, acc);
+	return parts[0] + parts[1] + tail;
+}
+
+#endif
+
+inline unsigned long long sadTileGeneric(const cv::Mat &cell, const cv::Mat &tile) {
+	return sadMat(cell, tile);
+}
+
+// Wybiera wersję SAD dla kafelków o danej szerokości: wyspecjalizowaną dla 8, 16, 20 i 32 pikseli, ogólną dla pozostałych.
+
+inline sadTileFunction sadTileFor(int width) {
+#ifdef MOZAIKA_SAD_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2")) {
+		switch (width) {
+			case 8: return sadTileSse2<8>;
+			case 16: return sadTileSse2<16>;
+			case 20: return sadTileSse2<20>;
+			case 32: return sadTileSse2<32>;
+		}
+		return sadTileGeneric;
+	}
+#endif
+	switch (width) {
+		case 8: return sadTileScalar<8>;
+		case 16: return sadTileScalar<16>;
+		case 20: return sadTileScalar<20>;
+		case 32: return sadTileScalar<32>;
+	}
+	return sadTileGeneric;
+}
+
+// Wylicza przystosowanie obszaru obrazu z kafelkiem tej samej wielkości wybraną wersją SAD - tak samo jak calculateFitness().
+
+inline long long tileFitness(sadTileFunction sad, const cv::Mat &cell, const cv::Mat &tile) {
+	return (long long)tile.rows * tile.cols * 255 * 3 - (long long)sad(cell, tile);
+}
+
+// Sprawdza, czy wszystkie wersje SAD dostępne na tym procesorze, razem z wyspecjalizowanymi wersjami skalarnymi, dają wynik
+// identyczny z sadScalar(), również dla nierównych długości i niewyrównanych adresów.
+
+inline bool sadSelfTest() {
+	unsigned char a[300], b[300];
+	unsigned int x = 12345;
+	for (int i = 0; i < 300; i++) { // deterministyczne dane pseudolosowe, z wartościami skrajnymi 0 i 255
+		x = x * 1103515245 + 12345;
+		a[i] = (i % 7 == 0) ? 255 : (x >> 16) & 0xff;
+		b[i] = (i % 11 == 0) ? 0 : (x >> 8) & 0xff;
+	}
+
+	for (int offset = 0; offset < 4; offset++) {
+		for (size_t n = 0; n + offset <= 300; n += 13) {
+			unsigned long long expected = sadScalar(a + offset, b, n);
+			if (sadBytes(a + offset, b, n) != expected) {
+				return false;
+			}
+#ifdef MOZAIKA_SAD_X86
+			if (sadSse2(a + offset, b, n) != expected) {
+				return false;
+			}
+			if (__builtin_cpu_supports("avx2") && sadAvx2(a + offset, b, n) != expected) {
+				return false;
+			}
+#endif
+		}
+	}
+
+	// wersje wyspecjalizowane i ogólna, na obszarze większego obrazu (wiersze nieciągłe); sadTileFor() wybiera na x86 wersje SSE2,
+	// więc wersje skalarne (jedyne na innych procesorach) sprawdzane są osobno
+	const int widths[] = {8, 16, 20, 32, 7};
+	const sadTileFunction scalarTiles[] = {sadTileScalar<8>, sadTileScalar<16>, sadTileScalar<20>, sadTileScalar<32>, sadTileGeneric};
+	for (int w = 0; w < 5; w++) {
+		int width = widths[w];
+		cv::Mat picture(3, width + 5, CV_8UC3), tile(2, width, CV_8UC3);
+		for (int i = 0; i < picture.rows * picture.cols * 3; i++) {
+			x = x * 1103515245 + 12345;
+			picture.ptr(0)[i] = (x >> 16) & 0xff;
+		}
+		for (int i = 0; i < tile.rows * tile.cols * 3; i++) {
+			x = x * 1103515245 + 12345;
+			tile.ptr(0)[i] = i % 5 == 0 ? 255 : (x >> 16) & 0xff;
+		}
+		cv::Mat cell = picture(cv::Rect(1, 1, width, 2));
+		unsigned long long expected = 0;
+		for (int i = 0; i < tile.rows; i++) {
+			expected += sadScalar(cell.ptr(i), tile.ptr(i), width * 3);
+		}
+		if (sadTileFor(width)(cell, tile) != expected || scalarTiles[w](cell, tile) != expected || sadTileGeneric(cell, tile) != expected) {
+			return false;
+		}
+	}
+	return true;
+}
+
+#endif
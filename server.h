@@ -0,0 +1,389 @@
+#ifndef MOZAIKA_SERVER_H
+#define MOZAIKA_SERVER_H
+
+#include <cv.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <poll.h>
+#include <sstream>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "batch.h"
+#include "grid.h"
+
+/*
+ * Tryb serwera: proces działa stale, z biblioteką kafelków wczytaną raz (dla kilku rozmiarów kafelków) i jedną pulą wątków,
+ * i przyjmuje zadania przez lokalne gniazdo Unix. Klient wysyła jedną linię z parametrami zadania, zapisanymi tak jak w linii
+ * poleceń (np. "--algorithm=greedy --grid=30x30 --tile=20 -p --output=/tmp/wynik.png /tmp/zdjecie.jpg"), i dostaje jedną linię
+ * odpowiedzi: "OK ... ms=czas queue_ms=czas_w_kolejce", "ERROR komunikat" albo "BUSY", gdy kolejka zadań jest pełna.
+ * Linia "STATS" zwraca statystyki serwera, a "SHUTDOWN" kończy pracę po wykonaniu zadań z kolejki.
+ *
+ * Wątek główny serwera obsługuje wszystkie połączenia naraz (poll): przyjmuje nowe i odczytuje z gotowych gniazd to, co już
+ * przyszło, więc wolny albo bezczynny klient nie wstrzymuje pozostałych. Zadania czekają w kolejce o ograniczonej pojemności
+ * i wykonywane są równolegle przez kilka wątków zadań; obliczenia równoległe wszystkich zadań korzystają ze wspólnej puli
+ * wątków (ThreadPool::run wykonuje jedno zadanie puli naraz).
+ */
+
+const int SERVER_READ_TIMEOUT = 5; // ile sekund czekać na linię zadania od klienta
+const int SERVER_MAX_LINE = 65536; // najdłuższa przyjmowana linia zadania
+const int SERVER_STATS_WINDOW = 10000; // z ilu ostatnich zadań liczone są percentyle czasu odpowiedzi
+
+// Wymiary siatki i parametry algorytmu genetycznego są zmiennymi globalnymi, wspólnymi dla wszystkich zadań. Zadania z tą
+// samą siatką mogą działać równocześnie, a zadanie z inną siatką albo zadanie wyłączne (algorytm genetyczny) czeka, aż skończą
+// się wszystkie wcześniejsze. Zadania wchodzą w kolejności zgłoszeń, więc zadanie wyłączne nie czeka w nieskończoność.
+
+class gridLock {
+public:
+	gridLock() : tickets(0), serving(0), active(0), activeExclusive(false) {}
+
+	// Czeka na swoją kolej i ustawia TILES_X, TILES_Y na wymiary grid.
+
+	void acquire(cv::Size grid, bool exclusive) {
+		std::unique_lock<std::mutex> lock(mutex);
+		long long ticket = tickets++;
+		changed.wait(lock, [&] {
+			return ticket == serving && (active == 0 || (!exclusive && !activeExclusive && grid == activeGrid));
+		});
+		serving++;
+		active++;
+		activeExclusive = exclusive;
+		activeGrid = grid;
+		TILES_X = grid.width;
+		TILES_Y = grid.height;
+		changed.notify_all();
+	}
+
+	void release() {
+		std::lock_guard<std::mutex> lock(mutex);
+		active--;
+		changed.notify_all();
+	}
+
+private:
+	long long tickets, serving; // numer następnego zgłoszenia i zgłoszenia, które może teraz wejść
+	int active; // ile zadań jest w środku
+	bool activeExclusive;
+	cv::Size activeGrid;
+	std::mutex mutex;
+	std::condition_variable changed;
+};
+
+// Czasy odpowiedzi (od przyjęcia zadania do wysłania wyniku) i liczniki zadań.
+
+class serverStats {
+public:
+	serverStats() : completed(0), failed(0), rejected(0), start(std::chrono::steady_clock::now()) {}
+
+	void record(double ms, bool ok) {
+		std::lock_guard<std::mutex> lock(mutex);
+		(ok ? completed : failed)++;
+		latencies.push_back(ms);
+		if (latencies.size() > SERVER_STATS_WINDOW) {
+			latencies.pop_front();
+		}
+	}
+
+	void reject() {
+		std::lock_guard<std::mutex> lock(mutex);
+		rejected++;
+	}
+
+	std::string describe(int queued) {
+		std::lock_guard<std::mutex> lock(mutex);
+		std::vector<double> sorted(latencies.begin(), latencies.end());
+		std::sort(sorted.begin(), sorted.end());
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), sum = 0;
+		for (int i = 0; i < sorted.size(); i++) {
+			sum += sorted[i];
+		}
+
+		std::ostringstream out;
+		out << "completed=" << completed << " failed=" << failed << " rejected=" << rejected << " queued=" << queued
+				<< " uptime_s=" << seconds << " jobs_per_s=" << (completed + failed) / seconds
+				<< " mean_ms=" << (sorted.empty() ? 0 : sum / sorted.size()) << " p50_ms=" << percentile(sorted, 50)
+				<< " p95_ms=" << percentile(sorted, 95) << " max_ms=" << (sorted.empty() ? 0 : sorted.back());
+		return out.str();
+	}
+
+private:
+	static double percentile(const std::vector<double> &sorted, int p) {
+		return sorted.empty() ? 0 : sorted[std::min<size_t>(sorted.size() - 1, sorted.size() * p / 100)];
+	}
+
+	long long completed, failed, rejected;
+	std::deque<double> latencies;
+	std::chrono::steady_clock::time_point start;
+	std::mutex mutex;
+};
+
+// Zamienia linię zadania na parametry, tak jak parseOptions() robi to z linią poleceń.
+
+inline bool parseRequest(const std::string &line, options &opts) {
+	std::istringstream in(line);
+	std::vector<std::string> words;
+	std::string word;
+	while (in >> word) {
+		words.push_back(word);
+	}
+
+	std::vector<char *> argv(1, (char *)"zadanie");
+	for (int i = 0; i < words.size(); i++) {
+		argv.push_back(&words[i][0]);
+	}
+	return parseOptions(argv.size(), argv.data(), opts);
+}
+
+// Połączenie, od którego serwer czeka jeszcze na linię zadania.
+
+struct pendingClient {
+	int fd;
+	std::string buffer; // odebrane dotąd bajty
+	std::chrono::steady_clock::time_point deadline; // po tym czasie połączenie jest zamykane
+};
+
+inline void setBlocking(int fd, bool blocking) {
+	int flags = fcntl(fd, F_GETFL, 0);
+	fcntl(fd, F_SETFL, blocking ? flags & ~O_NONBLOCK : flags | O_NONBLOCK);
+}
+
+// Odbiera z gniazda klienta (nieblokującego) wszystko, co już przyszło. Zwraca false, gdy klient zamknął połączenie, wystąpił
+// błąd albo linia jest za długa. complete mówi, czy przyszła już cała linia - wtedy jest w line (bez znaku końca linii).
+
+inline bool receiveLine(pendingClient &client, std::string &line, bool &complete) {
+	char data[4096];
+	complete = false;
+	while (true) {
+		ssize_t n = recv(client.fd, data, sizeof(data), 0);
+		if (n > 0) {
+			client.buffer.append(data, n);
+			size_t end = client.buffer.find('\n');
+			if (end != std::string::npos) {
+				line = client.buffer.substr(0, end);
+				line.erase(line.find_last_not_of("\r") + 1);
+				complete = true;
+				return true;
+			}
+			if (client.buffer.size() > SERVER_MAX_LINE) {
+				return false;
+			}
+			continue;
+		}
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK); // nic więcej na razie nie przyszło
+	}
+}
+
+inline void reply(int client, const std::string &line) {
+	std::string data = line + "\n";
+	send(client, data.data(), data.size(), MSG_NOSIGNAL); // klient mógł się już rozłączyć
+	close(client);
+}
+
+// Wykonuje zadanie: zwraca true i opis wyniku albo false i komunikat błędu.
+
+typedef std::function<bool(const options &, std::string &)> jobHandler;
+
+struct serverJob {
+	long long id;
+	int client;
+	options opts;
+	std::chrono::steady_clock::time_point received;
+};
+
+// Nasłuchuje na gnieździe path, aż klient wyśle "SHUTDOWN". Zadania wykonuje jobThreads wątków, w kolejce czeka najwyżej
+// queueCapacity zadań. Zwraca false, gdy nie udało się utworzyć gniazda.
+
+inline bool runServer(const std::string &path, int jobThreads, int queueCapacity, const jobHandler &handler) {
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(address.sun_path)) {
+		std::cout << "Za długa ścieżka gniazda " << path << "\n";
+		return false;
+	}
+	strcpy(address.sun_path, path.c_str());
+
+	struct stat st;
+	if (lstat(path.c_str(), &st) == 0) {
+		if (!S_ISSOCK(st.st_mode)) {
+			std::cout << "Plik " << path << " istnieje i nie jest gniazdem - serwer nie zostanie uruchomiony\n";
+			return false;
+		}
+		unlink(path.c_str()); // gniazdo po poprzednim uruchomieniu
+	}
+
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0 || bind(listener, (sockaddr *)&address, sizeof(address)) != 0 || listen(listener, 64) != 0) {
+		std::cout << "Błąd tworzenia gniazda " << path << ": " << strerror(errno) << "\n";
+		if (listener >= 0) {
+			close(listener);
+		}
+		return false;
+	}
+	std::cout << "Serwer nasłuchuje na " << path << " (wątki zadań: " << jobThreads << ", kolejka: " << queueCapacity << ")\n";
+
+	blockingQueue<serverJob> jobs(queueCapacity);
+	serverStats stats;
+	std::mutex logMutex;
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < jobThreads; t++) {
+		threads.push_back(std::thread([&] {
+			serverJob job;
+			while (jobs.pop(job)) {
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				std::string result;
+				bool ok = handler(job.opts, result);
+				std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+				double ms = std::chrono::duration<double, std::milli>(end - job.received).count();
+				double queueMs = std::chrono::duration<double, std::milli>(start - job.received).count();
+
+				std::ostringstream line;
+				line << (ok ? "OK " : "ERROR ") << result;
+				if (ok) {
+					line << " ms=" << ms << " queue_ms=" << queueMs;
+				}
+				reply(job.client, line.str());
+				stats.record(ms, ok);
+
+				std::lock_guard<std::mutex> lock(logMutex);
+				std::cout << "Zadanie " << job.id << ": " << (ok ? "gotowe" : "błąd") << " w " << ms << " ms (w kolejce " << queueMs << " ms)\n";
+			}
+		}));
+	}
+
+	setBlocking(listener, false);
+	std::vector<pendingClient> clients;
+	long long nextId = 1;
+	bool running = true;
+
+	// Obsługuje pełną linię od klienta: odpowiada na STATS i SHUTDOWN albo wstawia zadanie do kolejki.
+	auto handleLine = [&](int client, const std::string &line) {
+		setBlocking(client, true); // odpowiedź wysyłana jest w całości, także z wątku zadań
+		if (line == "STATS") {
+			reply(client, "OK " + stats.describe(jobs.size()));
+			return;
+		}
+		if (line == "SHUTDOWN") {
+			reply(client, "OK");
+			running = false;
+			return;
+		}
+
+		serverJob job;
+		job.id = nextId++;
+		job.client = client;
+		job.received = std::chrono::steady_clock::now();
+		if (!parseRequest(line, job.opts)) {
+			reply(client, "ERROR Błąd odczytu pliku konfiguracyjnego");
+			return;
+		}
+		if (!jobs.tryPush(job)) {
+			stats.reject();
+			reply(client, "BUSY");
+		}
+	};
+
+	while (running) {
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		std::vector<pollfd> fds(1);
+		fds[0].fd = listener;
+		fds[0].events = POLLIN;
+		int timeout = -1; // do najbliższego terminu klienta
+		for (int i = 0; i < clients.size(); i++) {
+			pollfd fd;
+			fd.fd = clients[i].fd;
+			fd.events = POLLIN;
+			fds.push_back(fd);
+			long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(clients[i].deadline - now).count() + 1;
+			timeout = timeout < 0 ? std::max(0LL, ms) : std::min<long long>(timeout, std::max(0LL, ms));
+		}
+
+		if (poll(fds.data(), fds.size(), timeout) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			std::cout << "Błąd gniazda " << path << ": " << strerror(errno) << "\n";
+			break;
+		}
+
+		std::vector<pendingClient> waiting; // klienci, od których linia jeszcze nie przyszła
+		now = std::chrono::steady_clock::now();
+		for (int i = 0; i < clients.size(); i++) {
+			pendingClient &client = clients[i];
+			if (fds[i + 1].revents != 0) {
+				std::string line;
+				bool complete;
+				if (!receiveLine(client, line, complete)) {
+					close(client.fd);
+					continue;
+				}
+				if (complete) {
+					if (running) {
+						handleLine(client.fd, line);
+					} else {
+						close(client.fd);
+					}
+					continue;
+				}
+			}
+			if (now >= client.deadline) {
+				close(client.fd); // klient nie wysłał całej linii w SERVER_READ_TIMEOUT sekund
+				continue;
+			}
+			waiting.push_back(client);
+		}
+		clients.swap(waiting);
+
+		if (running && (fds[0].revents & POLLIN)) {
+			while (true) {
+				int fd = accept(listener, NULL, NULL);
+				if (fd < 0) {
+					if (errno == EINTR || errno == ECONNABORTED) {
+						continue;
+					}
+					if (errno != EAGAIN && errno != EWOULDBLOCK) {
+						std::cout << "Błąd gniazda " << path << ": " << strerror(errno) << "\n";
+						running = false;
+					}
+					break; // przyjęto wszystkie oczekujące połączenia
+				}
+				setBlocking(fd, false);
+				pendingClient client;
+				client.fd = fd;
+				client.deadline = now + std::chrono::seconds(SERVER_READ_TIMEOUT);
+				clients.push_back(client);
+			}
+		}
+	}
+
+	for (int i = 0; i < clients.size(); i++) {
+		close(clients[i].fd);
+	}
+	jobs.close();
+	for (int t = 0; t < threads.size(); t++) {
+		threads[t].join();
+	}
+	close(listener);
+	unlink(path.c_str());
+	std::cout << "Serwer zakończył pracę: " << stats.describe(0) << "\n";
+	return true;
+}
+
+#endif
@@ -0,0 +1,269 @@
+#ifndef MOZAIKA_TELEMETRY_H
+#define MOZAIKA_TELEMETRY_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <string>
+
+/*
+ * Pomiary algorytmu genetycznego: czas poszczególnych faz tworzenia pokolenia, liczba i łączny rozmiar alokacji pamięci
+ * oraz przebieg zbieżności (najlepszy, średni i najgorszy fitness, różnorodność populacji), zapisywane po każdym pokoleniu
+ * do pliku CSV albo JSON (jeden obiekt w linii, gdy nazwa pliku kończy się na .json).
+ *
+ * Czasy faz są sumą czasów wszystkich wątków, więc przy wielu wątkach ich suma może przekraczać czas pokolenia.
+ * Liczone są alokacje operatora new (wektory, napisy), bez pamięci przydzielanej przez OpenCV.
+ *
+ * Każdy wątek dolicza pomiary do własnych liczników (w osobnej linii pamięci podręcznej, zwykłym zapisem, bez atomowego
+ * dodawania), więc wątki algorytmu genetycznego nie rywalizują o wspólne zmienne. takeTelemetry() sumuje liczniki wszystkich
+ * wątków i odejmuje stan z poprzedniego odczytu - sam niczego w nich nie zapisuje.
+ *
+ * Kompilacja z -DMOZAIKA_NO_TELEMETRY całkowicie usuwa pomiary: TELEMETRY_PHASE nie generuje żadnego kodu,
+ * a operator new nie jest podmieniany. Nagłówek podmienia globalny operator new, więc w programie może go dołączać
+ * tylko jeden plik .cpp (tak jak ga.h).
+ */
+
+enum telemetryPhase { PHASE_TOURNAMENT, PHASE_CROSSOVER, PHASE_MUTATION, PHASE_FITNESS, PHASE_RENDER, PHASE_COPY, PHASE_COUNT };
+
+const char *const PHASE_NAMES[PHASE_COUNT] = {"tournament", "crossover", "mutation", "fitness", "render", "copy"};
+
+struct telemetryCounters { // liczniki zebrane od ostatniego odczytu
+	long long phaseNs[PHASE_COUNT];
+	long long allocations;
+	long long allocatedBytes;
+};
+
+struct generationStats { // przebieg zbieżności w jednym pokoleniu
+	long long best, worst;
+	double mean;
+	double diversity; // średni odsetek pól, na których osobnik różni się od najlepszego (0 - populacja jednakowa)
+};
+
+#ifndef MOZAIKA_NO_TELEMETRY
+
+struct alignas(64) telemetryThread { // liczniki jednego wątku, rosnące od jego startu
+	std::atomic<long long> phaseNs[PHASE_COUNT];
+	std::atomic<long long> allocations, allocatedBytes;
+	telemetryCounters taken; // stan przy poprzednim takeTelemetry(), zmieniany tylko przez takeTelemetry()
+	telemetryThread *next;
+};
+
+std::atomic<telemetryThread *> telemetryThreads(NULL); // lista liczników wszystkich wątków, które coś zmierzyły
+thread_local telemetryThread *telemetrySelf = NULL;
+
+// Liczniki bieżącego wątku, tworzone przy pierwszym pomiarze. Przydzielane przez posix_memalign, nie przez operator new,
+// który sam z nich korzysta. Liczniki nie są zwalniane po zakończeniu wątku, więc jego pomiary trafią do następnego odczytu.
+
+inline telemetryThread &telemetryCurrentThread() {
+	if (telemetrySelf == NULL) {
+		void *memory = NULL;
+		if (posix_memalign(&memory, alignof(telemetryThread), sizeof(telemetryThread)) != 0) {
+			throw std::bad_alloc();
+		}
+		telemetryThread *t = new (memory) telemetryThread;
+		for (int i = 0; i < PHASE_COUNT; i++) {
+			t->phaseNs[i].store(0, std::memory_order_relaxed);
+		}
+		t->allocations.store(0, std::memory_order_relaxed);
+		t->allocatedBytes.store(0, std::memory_order_relaxed);
+		t->taken = telemetryCounters();
+		t->next = telemetryThreads.load();
+		while (!telemetryThreads.compare_exchange_weak(t->next, t)) {
+		}
+		telemetrySelf = t;
+	}
+	return *telemetrySelf;
+}
+
+// Dolicza wartość do licznika bieżącego wątku. Zapisuje go tylko ten wątek, więc wystarczy odczyt i zapis zamiast fetch_add.
+
+inline void telemetryAdd(std::atomic<long long> &counter, long long value) {
+	counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+// Mierzy czas od utworzenia do końca zasięgu i dolicza go do danej fazy.
+
+class phaseTimer {
+public:
+	explicit phaseTimer(telemetryPhase phase) : phase(phase), start(std::chrono::steady_clock::now()) {}
+
+	~phaseTimer() {
+		long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		telemetryAdd(telemetryCurrentThread().phaseNs[phase], ns);
+	}
+
+private:
+	telemetryPhase phase;
+	std::chrono::steady_clock::time_point start;
+};
+
+#define TELEMETRY_JOIN2(a, b) a##b
+#define TELEMETRY_JOIN(a, b) TELEMETRY_JOIN2(a, b)
+#define TELEMETRY_PHASE(phase) phaseTimer TELEMETRY_JOIN(telemetryTimer, __LINE__)(phase)
+
+void *operator new(std::size_t size) {
+	telemetryThread &t = telemetryCurrentThread();
+	telemetryAdd(t.allocations, 1);
+	telemetryAdd(t.allocatedBytes, size);
+	void *p = std::malloc(size == 0 ? 1 : size);
+	if (p == NULL) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void *operator new[](std::size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void *p) noexcept {
+	std::free(p);
+}
+
+// Zwraca liczniki zebrane od poprzedniego wywołania (suma wszystkich wątków).
+
+inline telemetryCounters takeTelemetry() {
+	static std::mutex takeMutex; // chroni stany poprzednich odczytów
+	std::lock_guard<std::mutex> lock(takeMutex);
+
+	telemetryCounters c = telemetryCounters();
+	for (telemetryThread *t = telemetryThreads.load(); t != NULL; t = t->next) {
+		for (int i = 0; i < PHASE_COUNT; i++) {
+			long long now = t->phaseNs[i].load(std::memory_order_relaxed);
+			c.phaseNs[i] += now - t->taken.phaseNs[i];
+			t->taken.phaseNs[i] = now;
+		}
+		long long allocations = t->allocations.load(std::memory_order_relaxed), bytes = t->allocatedBytes.load(std::memory_order_relaxed);
+		c.allocations += allocations - t->taken.allocations;
+		c.allocatedBytes += bytes - t->taken.allocatedBytes;
+		t->taken.allocations = allocations;
+		t->taken.allocatedBytes = bytes;
+	}
+	return c;
+}
+
+#else
+
+#define TELEMETRY_PHASE(phase)
+
+inline telemetryCounters takeTelemetry() {
+	telemetryCounters c = telemetryCounters();
+	return c;
+}
+
+#endif
+
+// Plik z pomiarami kolejnych pokoleń. Dopóki open() się nie powiedzie, write() nic nie robi.
+
+class telemetryLog {
+public:
+	telemetryLog() : json(false), run(0) {
+		totals = telemetryCounters();
+	}
+
+	bool open(const std::string &path) {
+#ifdef MOZAIKA_NO_TELEMETRY
+		std::cout << "Program skompilowano z MOZAIKA_NO_TELEMETRY, pomiary nie będą zapisane\n";
+		return false;
+#endif
+		out.open(path.c_str());
+		if (!out) {
+			std::cout << "Błąd zapisu pliku pomiarów " << path << "\n";
+			return false;
+		}
+
+		json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+		if (!json) {
+			out << "run,generation,generation_us";
+			for (int i = 0; i < PHASE_COUNT; i++) {
+				out << "," << PHASE_NAMES[i] << "_us";
+			}
+			out << ",allocations,allocated_bytes,best,mean,worst,diversity\n";
+		}
+		return true;
+	}
+
+	bool isOpen() const {
+		return out.is_open();
+	}
+
+	// Zaczyna nowy przebieg algorytmu (kolejny obraz w trybie wsadowym): zeruje liczniki i sumy faz.
+
+	void beginRun() {
+		run++;
+		totals = telemetryCounters();
+		takeTelemetry();
+	}
+
+	void write(int generation, double generationSeconds, const generationStats &stats) {
+		telemetryCounters c = takeTelemetry();
+		if (!isOpen()) {
+			return;
+		}
+		addToTotals(c);
+
+		long long generationUs = (long long)(generationSeconds * 1e6);
+		if (json) {
+			out << "{\"run\": " << run << ", \"generation\": " << generation << ", \"generation_us\": " << generationUs;
+			for (int i = 0; i < PHASE_COUNT; i++) {
+				out << ", \"" << PHASE_NAMES[i] << "_us\": " << c.phaseNs[i] / 1000;
+			}
+			out << ", \"allocations\": " << c.allocations << ", \"allocated_bytes\": " << c.allocatedBytes
+					<< ", \"best\": " << stats.best << ", \"mean\": " << stats.mean << ", \"worst\": " << stats.worst
+					<< ", \"diversity\": " << stats.diversity << "}\n";
+		} else {
+			out << run << "," << generation << "," << generationUs;
+			for (int i = 0; i < PHASE_COUNT; i++) {
+				out << "," << c.phaseNs[i] / 1000;
+			}
+			out << "," << c.allocations << "," << c.allocatedBytes << "," << stats.best << "," << stats.mean << ","
+					<< stats.worst << "," << stats.diversity << "\n";
+		}
+		out.flush(); // plik można śledzić w trakcie działania programu
+	}
+
+	// Wypisuje sumaryczny czas faz i alokacje bieżącego przebiegu, łącznie z pracą wykonaną po ostatnim pokoleniu
+	// (np. rysowaniem wynikowej mozaiki).
+
+	void printSummary() {
+		if (!isOpen()) {
+			return;
+		}
+
+		addToTotals(takeTelemetry());
+
+		long long total = 0;
+		for (int i = 0; i < PHASE_COUNT; i++) {
+			total += totals.phaseNs[i];
+		}
+		std::cout << "Czas faz (suma wątków):";
+		for (int i = 0; i < PHASE_COUNT; i++) {
+			std::cout << " " << PHASE_NAMES[i] << " " << totals.phaseNs[i] / 1e9 << " s (" << (total > 0 ? 100 * totals.phaseNs[i] / total : 0) << "%)";
+		}
+		std::cout << "\nAlokacje: " << totals.allocations << ", " << totals.allocatedBytes / (1024 * 1024) << " MB\n";
+	}
+
+private:
+	void addToTotals(const telemetryCounters &c) {
+		for (int i = 0; i < PHASE_COUNT; i++) {
+			totals.phaseNs[i] += c.phaseNs[i];
+		}
+		totals.allocations += c.allocations;
+		totals.allocatedBytes += c.allocatedBytes;
+	}
+
+	std::ofstream out;
+	bool json;
+	int run;
+	telemetryCounters totals;
+};
+
+#endif
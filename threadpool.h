@@ -0,0 +1,115 @@
+#ifndef MOZAIKA_THREADPOOL_H
+#define MOZAIKA_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Stała pula wątków roboczych. Wątki są tworzone raz, przy starcie programu, i czekają na kolejne zadania.
+ * Wątek wywołujący run() jest pracownikiem numer 0, więc pula o rozmiarze N tworzy N-1 dodatkowych wątków.
+ * Zadania nie mogą same wywoływać run() na tej samej puli.
+ */
+
+class ThreadPool {
+public:
+	explicit ThreadPool(int threads = 0) : stop(false), jobId(0), pending(0), job(NULL) {
+		if (threads <= 0) { // domyślnie tyle wątków, ile rdzeni
+			threads = std::thread::hardware_concurrency();
+		}
+		if (threads <= 0) {
+			threads = 1;
+		}
+		count = threads;
+
+		for (int i = 1; i < count; i++) {
+			workers.push_back(std::thread(&ThreadPool::loop, this, i));
+		}
+	}
+
+	~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+		}
+		start.notify_all();
+		for (int i = 0; i < workers.size(); i++) {
+			workers[i].join();
+		}
+	}
+
+	int size() const {
+		return count;
+	}
+
+	// Wykonuje f(worker) raz na każdym wątku puli i czeka na zakończenie wszystkich. Podział pracy należy do f,
+	// dzięki czemu przy stałym podziale (np. co size()-ty element) wynik nie zależy od kolejności wykonania wątków.
+
+	void run(const std::function<void(int)> &f) {
+		std::lock_guard<std::mutex> runLock(runMutex); // jedno zadanie naraz, nawet gdy run() wołany jest z kilku wątków
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			job = &f;
+			pending = count - 1;
+			jobId++;
+		}
+		start.notify_all();
+
+		f(0);
+
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this] { return pending == 0; });
+		job = NULL;
+	}
+
+	// Wykonuje f(i, worker) dla i = 0..n-1, rozdzielając indeksy dynamicznie między wątki. Kolejność wykonania nie jest
+	// określona, więc wyniki należy zapisywać pod indeksem i.
+
+	void parallelFor(int n, const std::function<void(int, int)> &f) {
+		std::atomic<int> next(0);
+		run([&](int worker) {
+			for (int i = next++; i < n; i = next++) {
+				f(i, worker);
+			}
+		});
+	}
+
+private:
+	void loop(int worker) {
+		long long seen = 0;
+		while (true) {
+			const std::function<void(int)> *f;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				start.wait(lock, [&] { return stop || jobId != seen; });
+				if (stop) {
+					return;
+				}
+				seen = jobId;
+				f = job;
+			}
+
+			(*f)(worker);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--pending == 0) {
+				done.notify_all();
+			}
+		}
+	}
+
+	int count; // liczba pracowników razem z wątkiem wywołującym
+	bool stop;
+	long long jobId; // numer bieżącego zadania, pozwala wątkom rozpoznać nowe zadanie
+	int pending; // ilu dodatkowych wątków jeszcze nie skończyło bieżącego zadania
+	const std::function<void(int)> *job;
+	std::vector<std::thread> workers;
+	std::mutex mutex, runMutex;
+	std::condition_variable start, done;
+};
+
+#endif
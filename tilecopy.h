@@ -0,0 +1,52 @@
+#ifndef MOZAIKA_TILECOPY_H
+#define MOZAIKA_TILECOPY_H
+
+#include <cv.h>
+#include <cstring>
+
+/*
+ * Kopiowanie kafelka (CV_8UC3) na jego miejsce w mozaice, od razu z odbiciem lustrzanym, gdy jest potrzebne - bez osobnego
+ * przejścia cv::flip() po skopiowanym obszarze. Dla najczęstszych szerokości kafelków (8, 16, 20, 32 piksele) długość wiersza
+ * jest stałą czasu kompilacji, więc kopiowanie wiersza to kilka instrukcji wektorowych, a odbicie - w pełni rozwinięta pętla.
+ */
+
+typedef void (*copyTileFunction)(const cv::Mat &, cv::Mat &, bool);
+
+template <int W>
+inline void copyTileFixed(const cv::Mat &tile, cv::Mat &place, bool reflect) {
+	for (int i = 0; i < tile.rows; i++) {
+		const unsigned char *src = tile.ptr(i);
+		unsigned char *dst = place.ptr(i);
+		if (!reflect) {
+			memcpy(dst, src, W * 3);
+			continue;
+		}
+		for (int j = 0; j < W; j++) {
+			dst[3 * j] = src[3 * (W - 1 - j)];
+			dst[3 * j + 1] = src[3 * (W - 1 - j) + 1];
+			dst[3 * j + 2] = src[3 * (W - 1 - j) + 2];
+		}
+	}
+}
+
+inline void copyTileGeneric(const cv::Mat &tile, cv::Mat &place, bool reflect) {
+	if (reflect) {
+		cv::flip(tile, place, 1);
+	} else {
+		tile.copyTo(place);
+	}
+}
+
+// Wybiera wersję kopiowania dla kafelków o danej szerokości.
+
+inline copyTileFunction copyTileFor(int width) {
+	switch (width) {
+		case 8: return copyTileFixed<8>;
+		case 16: return copyTileFixed<16>;
+		case 20: return copyTileFixed<20>;
+		case 32: return copyTileFixed<32>;
+	}
+	return copyTileGeneric;
+}
+
+#endif
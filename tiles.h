@@ -0,0 +1,621 @@
+#ifndef MOZAIKA_TILES_H
+#define MOZAIKA_TILES_H
+
+#include <cv.h>
+#include <highgui.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "threadpool.h"
+
+/*
+ * Biblioteka kafelków z trwałą pamięcią podręczną.
+ *
+ * Przy pierwszym uruchomieniu obrazy JPG z katalogu biblioteki są dekodowane, zmniejszane i zapisywane do jednego pliku
+ * binarnego (TILE_CACHE_FILE w tym samym katalogu) razem ze średnimi kolorami kafelków oraz nazwą, rozmiarem i datą
+ * modyfikacji każdego pliku źródłowego. Kolejne uruchomienia mapują ten plik do pamięci (mmap) i zwracają macierze
+ * cv::Mat wskazujące bezpośrednio na jego zawartość, bez dekodowania JPG. Plik może przechowywać kafelki w kilku rozmiarach.
+ * Zmiana zawartości katalogu powoduje jego ponowne zbudowanie, a prośba o nowy rozmiar - zdekodowanie plików tylko w tym
+ * rozmiarze i zapisanie go razem z rozmiarami skopiowanymi z dotychczasowego pliku.
+ *
+ * Układ pliku: tileCacheHeader | tileCacheSource[fileCount] | tileCacheSize[sizeCount] | uint32 sourceIndex[tileCount] |
+ * nazwy plików | dla każdego rozmiaru (wyrównane do 64 bajtów): double średnie[tileCount * 3], piksele BGR[tileCount * w * h * 3]
+ */
+
+#define TILE_CACHE_FILE "tiles.cache"
+#define TILE_CACHE_MAGIC "MOZAIKA\0"
+#define TILE_CACHE_VERSION 1
+
+struct tileSource { // plik źródłowy biblioteki
+	std::string name;
+	unsigned long long fileSize;
+	long long mtime;
+};
+
+struct tileCacheHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t fileCount; // ilość plików JPG w katalogu (także tych, których nie udało się odczytać)
+	uint32_t tileCount; // ilość kafelków, czyli poprawnie odczytanych plików
+	uint32_t sizeCount; // ilość zapisanych rozmiarów kafelków
+	uint64_t namesBytes;
+};
+
+struct tileCacheSource {
+	uint64_t fileSize;
+	int64_t mtime;
+	uint64_t nameOffset;
+	uint32_t nameLength;
+	uint32_t reserved;
+};
+
+struct tileCacheSize {
+	int32_t width;
+	int32_t height;
+	uint64_t meansOffset; // przesunięcie od początku pliku
+	uint64_t pixelsOffset;
+};
+
+struct tileCache { // zmapowany plik pamięci podręcznej
+	const char *data;
+	size_t length;
+	const tileCacheHeader *header;
+	const tileCacheSource *sources;
+	const tileCacheSize *sizes;
+	const uint32_t *sourceIndex;
+	const char *names;
+};
+
+// Zwraca posortowaną listę plików JPG z katalogu. Zwraca false, gdy katalogu nie da się odczytać.
+
+inline bool listTileSources(const char *directory, std::vector<tileSource> &sources) {
+	DIR *dir;
+	struct dirent *ent;
+
+	if ((dir = opendir(directory)) == NULL) {
+		return false;
+	}
+
+	while ((ent = readdir(dir)) != NULL) {
+		std::string fn = ent->d_name; // pobierz nazwę pliku
+		if (fn.substr(fn.find_last_of(".") + 1) == "jpg") { // czy to plik .jpg
+			struct stat st;
+			if (stat((std::string(directory) + "/" + fn).c_str(), &st) == 0) {
+				tileSource source;
+				source.name = fn;
+				source.fileSize = st.st_size;
+				source.mtime = st.st_mtime;
+				sources.push_back(source);
+			}
+		}
+	}
+	closedir(dir);
+
+	std::sort(sources.begin(), sources.end(), [](const tileSource &a, const tileSource &b) { return a.name < b.name; }); // stała kolejność kafelków
+	return true;
+}
+
+// Mapuje plik pamięci podręcznej i sprawdza jego spójność. Mapowanie zwalnia unmapTileCache() - dopiero wtedy, gdy nie wskazują
+// już na nie żadne kafelki (zob. sharedTileCache()).
+
+inline bool mapTileCache(const std::string &path, tileCache &cache) {
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(tileCacheHeader)) {
+		close(fd);
+		return false;
+	}
+
+	void *data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0); // prywatne mapowanie: ewentualny zapis do kafelka nie trafi do pliku
+	close(fd);
+	if (data == MAP_FAILED) {
+		return false;
+	}
+
+	cache.data = (const char *)data;
+	cache.length = st.st_size;
+	cache.header = (const tileCacheHeader *)data;
+
+	const tileCacheHeader *h = cache.header;
+	uint64_t tablesEnd = sizeof(tileCacheHeader) + (uint64_t)h->fileCount * sizeof(tileCacheSource)
+			+ (uint64_t)h->sizeCount * sizeof(tileCacheSize) + (uint64_t)h->tileCount * sizeof(uint32_t);
+	bool valid = memcmp(h->magic, TILE_CACHE_MAGIC, 8) == 0 && h->version == TILE_CACHE_VERSION && tablesEnd + h->namesBytes <= cache.length;
+
+	if (valid) {
+		cache.sources = (const tileCacheSource *)(cache.data + sizeof(tileCacheHeader));
+		cache.sizes = (const tileCacheSize *)(cache.sources + h->fileCount);
+		cache.sourceIndex = (const uint32_t *)(cache.sizes + h->sizeCount);
+		cache.names = cache.data + tablesEnd;
+
+		for (int i = 0; i < h->sizeCount && valid; i++) {
+			const tileCacheSize &s = cache.sizes[i];
+			uint64_t pixelsEnd = s.pixelsOffset + (uint64_t)h->tileCount * s.width * s.height * 3;
+			valid = s.width > 0 && s.height > 0 && s.meansOffset + (uint64_t)h->tileCount * 3 * sizeof(double) <= s.pixelsOffset && pixelsEnd <= cache.length;
+		}
+		for (int i = 0; i < h->fileCount && valid; i++) {
+			valid = cache.sources[i].nameOffset + cache.sources[i].nameLength <= h->namesBytes;
+		}
+	}
+
+	if (!valid) {
+		munmap(data, st.st_size);
+		return false;
+	}
+	return true;
+}
+
+inline void unmapTileCache(const tileCache &cache) {
+	munmap((void *)cache.data, cache.length);
+}
+
+// Przekazuje zmapowaną pamięć podręczną wspólnemu właścicielowi: mapowanie jest zwalniane, gdy zniknie ostatnia kopia wskaźnika
+// (np. razem z ostatnim zbiorem kafelków, które na nie wskazują).
+
+inline std::shared_ptr<const tileCache> sharedTileCache(const tileCache &cache) {
+	return std::shared_ptr<const tileCache>(new tileCache(cache), [](const tileCache *mapped) {
+		unmapTileCache(*mapped);
+		delete mapped;
+	});
+}
+
+// Czy pamięć podręczna opisuje dokładnie te same pliki źródłowe (nazwa, rozmiar, data modyfikacji).
+
+inline bool tileCacheMatches(const tileCache &cache, const std::vector<tileSource> &sources) {
+	if (cache.header->fileCount != sources.size()) {
+		return false;
+	}
+	for (int i = 0; i < sources.size(); i++) {
+		const tileCacheSource &s = cache.sources[i];
+		if (s.fileSize != sources[i].fileSize || s.mtime != sources[i].mtime
+				|| std::string(cache.names + s.nameOffset, s.nameLength) != sources[i].name) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Zwraca indeks rozmiaru kafelków w pamięci podręcznej albo -1, gdy tego rozmiaru w niej nie ma.
+
+inline int tileCacheSizeIndex(const tileCache &cache, cv::Size tileSize) {
+	for (int i = 0; i < cache.header->sizeCount; i++) {
+		if (cache.sizes[i].width == tileSize.width && cache.sizes[i].height == tileSize.height) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+// Odczytuje wymiary obrazu JPG z nagłówka (znacznik SOF), bez dekodowania. Zwraca false dla plików, które nie wyglądają na JPG.
+
+inline bool jpegSize(const std::string &path, cv::Size &size) {
+	std::ifstream in(path.c_str(), std::ios::binary);
+	unsigned char b[8];
+
+	if (!in.read((char *)b, 2) || b[0] != 0xFF || b[1] != 0xD8) {
+		return false;
+	}
+
+	while (in.read((char *)b, 4)) { // kolejne segmenty: FF, typ znacznika, 16-bitowa długość
+		if (b[0] != 0xFF) {
+			return false;
+		}
+		if (b[1] == 0xFF) { // bajty wypełnienia przed znacznikiem
+			in.seekg(-3, std::ios::cur);
+			continue;
+		}
+
+		int marker = b[1], length = (b[2] << 8) | b[3];
+		bool sof = marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+		if (sof) {
+			if (!in.read((char *)b, 5)) {
+				return false;
+			}
+			size = cv::Size((b[3] << 8) | b[4], (b[1] << 8) | b[2]);
+			return size.width > 0 && size.height > 0;
+		}
+		if (length < 2) {
+			return false;
+		}
+		in.seekg(length - 2, std::ios::cur);
+	}
+	return false;
+}
+
+// Dekodowanie w zmniejszonej rozdzielczości (cv::IMREAD_REDUCED_COLOR_*) jest dostępne od OpenCV 3.1. OpenCV 2.4 definiuje
+// CV_VERSION_EPOCH (wtedy CV_VERSION_MAJOR to druga liczba wersji), a starsze wersje nie definiują CV_VERSION_MAJOR.
+
+#if defined(CV_VERSION_MAJOR) && !defined(CV_VERSION_EPOCH) && (CV_VERSION_MAJOR > 3 || (CV_VERSION_MAJOR == 3 && CV_VERSION_MINOR >= 1))
+#define MOZAIKA_REDUCED_DECODE
+#endif
+
+// Wybiera tryb odczytu z dekodowaniem w dziedzinie DCT (1/2, 1/4, 1/8 rozdzielczości) - najmniejszy, który nadal daje obraz
+// nie mniejszy niż największy z docelowych rozmiarów kafelków. Bez MOZAIKA_REDUCED_DECODE obraz dekodowany jest w pełnej
+// rozdzielczości (wywołujący i tak zmniejsza go do rozmiaru kafelka).
+
+inline int reducedReadFlag(const cv::Size &pictureSize, const std::vector<cv::Size> &sizes) {
+#ifdef MOZAIKA_REDUCED_DECODE
+	int maxWidth = 0, maxHeight = 0;
+	for (int i = 0; i < sizes.size(); i++) {
+		maxWidth = std::max(maxWidth, sizes[i].width);
+		maxHeight = std::max(maxHeight, sizes[i].height);
+	}
+
+	const int factors[] = {8, 4, 2};
+	const int flags[] = {cv::IMREAD_REDUCED_COLOR_8, cv::IMREAD_REDUCED_COLOR_4, cv::IMREAD_REDUCED_COLOR_2};
+	for (int i = 0; i < 3; i++) {
+		if (pictureSize.width / factors[i] >= maxWidth && pictureSize.height / factors[i] >= maxHeight) {
+			return flags[i];
+		}
+	}
+#endif
+	return CV_LOAD_IMAGE_COLOR;
+}
+
+// Dekoduje pliki źródłowe o numerach files (indeksy w sources) i zmniejsza każdy do wszystkich podanych rozmiarów. Pliki
+// dekodowane są równolegle na wątkach puli, a wyniki trafiają na miejsce odpowiadające kolejności plików, więc kolejność
+// kafelków nie zależy od wątków. Plików, których nie da się odczytać, nie ma w wyniku. Postęp i podsumowanie wypisywane są
+// tylko, gdy verbose (pominięte pliki - zawsze).
+
+inline void decodeTiles(const char *directory, const std::vector<tileSource> &sources, const std::vector<uint32_t> &files,
+		const std::vector<cv::Size> &sizes, std::vector<std::vector<cv::Mat> > &tilesPerSize, std::vector<uint32_t> &sourceIndex,
+		ThreadPool &pool, bool verbose = true) {
+	std::vector<std::vector<cv::Mat> > decoded(files.size()); // kafelki każdego pliku we wszystkich rozmiarach, puste dla plików nieczytelnych
+	std::atomic<int> finished(0), skipped(0);
+	std::mutex reportMutex;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	int reportEvery = std::max(100, (int)files.size() / 20);
+
+	pool.parallelFor(files.size(), [&](int i, int) {
+		const tileSource &source = sources[files[i]];
+		std::string path = std::string(directory) + "/" + source.name;
+		cv::Size pictureSize;
+		int flag = jpegSize(path, pictureSize) ? reducedReadFlag(pictureSize, sizes) : CV_LOAD_IMAGE_COLOR;
+
+		cv::Mat picture = cv::imread(path, flag);
+		if (picture.data) {
+			for (int j = 0; j < sizes.size(); j++) {
+				cv::Mat tile;
+				cv::resize(picture, tile, sizes[j]);
+				decoded[i].push_back(tile);
+			}
+		} else {
+			skipped++;
+			std::lock_guard<std::mutex> lock(reportMutex);
+			std::cout << "Pominięto plik, którego nie da się odczytać: " << source.name << "\n";
+		}
+
+		int done = ++finished;
+		if (verbose && done % reportEvery == 0) {
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			std::lock_guard<std::mutex> lock(reportMutex);
+			std::cout << "Wczytano " << done << "/" << files.size() << " plików (" << (int)(done / seconds) << " plików/s)\n";
+		}
+	});
+
+	tilesPerSize.assign(sizes.size(), std::vector<cv::Mat>());
+	for (int i = 0; i < files.size(); i++) {
+		if (decoded[i].empty()) {
+			continue;
+		}
+		for (int j = 0; j < sizes.size(); j++) {
+			tilesPerSize[j].push_back(decoded[i][j]); // dodaj do tablicy kafelków
+		}
+		sourceIndex.push_back(files[i]);
+	}
+
+	if (!verbose) {
+		return;
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "Wczytano " << sourceIndex.size() << " kafelków w " << seconds << " s na " << pool.size() << " wątkach ("
+			<< (int)(files.size() / std::max(seconds, 1e-9)) << " plików/s), pominięto plików: " << skipped << "\n";
+}
+
+// Zapisuje pamięć podręczną do pliku tymczasowego i podmienia nim stary plik, więc inne procesy nigdy nie widzą pliku w połowie zapisanego.
+// Nazwa pliku tymczasowego jest unikalna (mkstemp), więc procesy budujące pamięć podręczną równocześnie sobie nie przeszkadzają.
+
+inline bool writeTileCache(const std::string &path, const std::vector<tileSource> &sources, const std::vector<cv::Size> &sizes,
+		const std::vector<std::vector<cv::Mat> > &tilesPerSize, const std::vector<uint32_t> &sourceIndex) {
+	tileCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, TILE_CACHE_MAGIC, 8);
+	header.version = TILE_CACHE_VERSION;
+	header.fileCount = sources.size();
+	header.tileCount = sourceIndex.size();
+	header.sizeCount = sizes.size();
+
+	std::vector<tileCacheSource> sourceRecords(sources.size());
+	std::string names;
+	for (int i = 0; i < sources.size(); i++) {
+		sourceRecords[i].fileSize = sources[i].fileSize;
+		sourceRecords[i].mtime = sources[i].mtime;
+		sourceRecords[i].nameOffset = names.size();
+		sourceRecords[i].nameLength = sources[i].name.size();
+		sourceRecords[i].reserved = 0;
+		names += sources[i].name;
+	}
+	header.namesBytes = names.size();
+
+	uint64_t offset = sizeof(header) + sourceRecords.size() * sizeof(tileCacheSource) + sizes.size() * sizeof(tileCacheSize)
+			+ sourceIndex.size() * sizeof(uint32_t) + names.size();
+	std::vector<tileCacheSize> sizeRecords(sizes.size());
+	for (int i = 0; i < sizes.size(); i++) { // bloki danych każdego rozmiaru zaczynają się od adresu podzielnego przez 64
+		offset = (offset + 63) / 64 * 64;
+		sizeRecords[i].width = sizes[i].width;
+		sizeRecords[i].height = sizes[i].height;
+		sizeRecords[i].meansOffset = offset;
+		sizeRecords[i].pixelsOffset = offset + sourceIndex.size() * 3 * sizeof(double);
+		offset = sizeRecords[i].pixelsOffset + (uint64_t)sourceIndex.size() * sizes[i].area() * 3;
+	}
+
+	std::vector<char> tempName(path.begin(), path.end());
+	const char suffix[] = ".XXXXXX";
+	tempName.insert(tempName.end(), suffix, suffix + sizeof(suffix)); // razem z kończącym zerem
+	int fd = mkstemp(tempName.data());
+	if (fd < 0) {
+		return false;
+	}
+	fchmod(fd, 0644); // mkstemp tworzy plik tylko dla właściciela
+	close(fd);
+	std::string tempPath(tempName.data());
+
+	std::ofstream out(tempPath.c_str(), std::ios::binary | std::ios::trunc);
+	if (!out) {
+		unlink(tempPath.c_str());
+		return false;
+	}
+
+	out.write((const char *)&header, sizeof(header));
+	out.write((const char *)sourceRecords.data(), sourceRecords.size() * sizeof(tileCacheSource));
+	out.write((const char *)sizeRecords.data(), sizeRecords.size() * sizeof(tileCacheSize));
+	out.write((const char *)sourceIndex.data(), sourceIndex.size() * sizeof(uint32_t));
+	out.write(names.data(), names.size());
+
+	for (int i = 0; i < sizes.size(); i++) {
+		std::string padding(sizeRecords[i].meansOffset - out.tellp(), '\0');
+		out.write(padding.data(), padding.size());
+
+		for (int j = 0; j < tilesPerSize[i].size(); j++) {
+			cv::Scalar avg = cv::mean(tilesPerSize[i][j]);
+			out.write((const char *)avg.val, 3 * sizeof(double));
+		}
+		for (int j = 0; j < tilesPerSize[i].size(); j++) {
+			const cv::Mat &tile = tilesPerSize[i][j];
+			for (int row = 0; row < tile.rows; row++) {
+				out.write((const char *)tile.ptr(row), tile.cols * 3);
+			}
+		}
+	}
+
+	out.close();
+	if (!out || rename(tempPath.c_str(), path.c_str()) != 0) {
+		unlink(tempPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+// Kafelki rozmiaru sizeIndex z pamięci podręcznej - macierze wskazujące na dane pliku, bez kopiowania.
+
+inline std::vector<cv::Mat> tileCacheTiles(const tileCache &cache, int sizeIndex) {
+	const tileCacheSize &s = cache.sizes[sizeIndex];
+	char *pixels = (char *)cache.data + s.pixelsOffset;
+	size_t tileBytes = (size_t)s.width * s.height * 3;
+
+	std::vector<cv::Mat> tiles;
+	tiles.reserve(cache.header->tileCount);
+	for (int i = 0; i < cache.header->tileCount; i++) {
+		tiles.push_back(cv::Mat(s.height, s.width, CV_8UC3, pixels + i * tileBytes));
+	}
+	return tiles;
+}
+
+struct tileSet { // kafelki jednego rozmiaru razem z ich średnimi kolorami i plikami źródłowymi
+	std::vector<cv::Mat> tiles;
+	std::vector<cv::Scalar> avgColors;
+	std::vector<std::string> sourcePaths; // do rysowania mozaiki w wyższej rozdzielczości (render.h)
+	std::shared_ptr<const tileCache> cache; // mapowanie pamięci podręcznej, na które wskazują kafelki (puste, gdy mają własną pamięć)
+};
+
+// Wypełnia set kafelkami rozmiaru sizeIndex ze zmapowanej pamięci podręcznej cache (mapping - jej właściciel).
+
+inline void fillTileSet(tileSet &set, const tileCache &cache, const std::shared_ptr<const tileCache> &mapping, int sizeIndex, const char *directory) {
+	const double *means = (const double *)(cache.data + cache.sizes[sizeIndex].meansOffset);
+	set = tileSet();
+	set.tiles = tileCacheTiles(cache, sizeIndex);
+	set.cache = mapping;
+	for (int i = 0; i < cache.header->tileCount; i++) {
+		set.avgColors.push_back(cv::Scalar(means[3 * i], means[3 * i + 1], means[3 * i + 2]));
+		const tileCacheSource &source = cache.sources[cache.sourceIndex[i]];
+		set.sourcePaths.push_back(std::string(directory) + "/" + std::string(cache.names + source.nameOffset, source.nameLength));
+	}
+}
+
+// Wczytuje do sets[i] kafelki rozmiaru sizes[i] z obrazów z podanego katalogu, razem z ich średnimi kolorami i ścieżkami plików
+// źródłowych. Wszystkie rozmiary, których brakuje w pamięci podręcznej, dekodowane są w jednym przejściu po plikach i zapisywane
+// jednym przebudowaniem pliku. Pliki dekodowane są na wątkach puli pool (NULL - na wszystkich rdzeniach). Komunikaty o budowaniu
+// biblioteki wypisywane są tylko, gdy verbose.
+
+inline void getTiles(std::vector<tileSet> &sets, const std::vector<cv::Size> &requested, const char* directory, ThreadPool *pool = NULL,
+		bool verbose = true) {
+	sets.assign(requested.size(), tileSet());
+	std::vector<tileSource> sources;
+	if (!listTileSources(directory, sources)) {
+		std::cout << "Błąd odczytu biblioteki obrazów\n";
+		return;
+	}
+
+	std::string cachePath = std::string(directory) + "/" + TILE_CACHE_FILE;
+	tileCache cache;
+	std::shared_ptr<const tileCache> mapping; // zwalnia mapowanie przy wyjściu, o ile nie przejmą go zbiory kafelków
+	if (mapTileCache(cachePath, cache)) {
+		mapping = sharedTileCache(cache);
+	}
+	bool current = mapping && tileCacheMatches(cache, sources);
+
+	std::vector<cv::Size> missing; // rozmiary, których nie ma w aktualnej pamięci podręcznej, bez powtórzeń
+	for (int i = 0; i < requested.size(); i++) {
+		if ((!current || tileCacheSizeIndex(cache, requested[i]) < 0) && std::find(missing.begin(), missing.end(), requested[i]) == missing.end()) {
+			missing.push_back(requested[i]);
+		}
+	}
+
+	if (!missing.empty()) {
+		std::unique_ptr<ThreadPool> ownPool;
+		if (pool == NULL) {
+			ownPool.reset(new ThreadPool());
+			pool = ownPool.get();
+		}
+
+		std::vector<cv::Size> sizes; // rozmiary zapisywane w nowym pliku, nowe na końcu
+		std::vector<std::vector<cv::Mat> > tilesPerSize;
+		std::vector<uint32_t> sourceIndex;
+
+		bool merge = current;
+		if (merge) { // zdekoduj tylko nowe rozmiary z plików, z których powstały kafelki, a pozostałe rozmiary skopiuj z pliku
+			if (verbose) {
+				std::cout << "Dodawanie kafelków";
+				for (int i = 0; i < missing.size(); i++) {
+					std::cout << " " << missing[i].width << "x" << missing[i].height;
+				}
+				std::cout << " do biblioteki " << cachePath << "\n";
+			}
+			std::vector<uint32_t> files(cache.sourceIndex, cache.sourceIndex + cache.header->tileCount);
+			decodeTiles(directory, sources, files, missing, tilesPerSize, sourceIndex, *pool, verbose);
+			merge = sourceIndex == files;
+			if (merge) {
+				tilesPerSize.insert(tilesPerSize.begin(), cache.header->sizeCount, std::vector<cv::Mat>());
+				for (int i = 0; i < cache.header->sizeCount; i++) {
+					sizes.push_back(cv::Size(cache.sizes[i].width, cache.sizes[i].height));
+					tilesPerSize[i] = tileCacheTiles(cache, i);
+				}
+				sizes.insert(sizes.end(), missing.begin(), missing.end());
+			}
+		}
+		if (!merge) { // pamięci podręcznej nie ma, jest nieaktualna albo któregoś pliku nie da się już odczytać - zbuduj ją od nowa
+			if (verbose) {
+				std::cout << "Budowanie biblioteki kafelków " << cachePath << "\n";
+			}
+			std::vector<uint32_t> files(sources.size());
+			for (int i = 0; i < files.size(); i++) {
+				files[i] = i;
+			}
+			sizes = current ? std::vector<cv::Size>() : missing;
+			if (current) { // pliku nie da się uzupełnić - zbuduj go od nowa razem z rozmiarami, które już w nim były
+				for (int i = 0; i < cache.header->sizeCount; i++) {
+					sizes.push_back(cv::Size(cache.sizes[i].width, cache.sizes[i].height));
+				}
+				sizes.insert(sizes.end(), missing.begin(), missing.end());
+			}
+			tilesPerSize.clear();
+			sourceIndex.clear();
+			decodeTiles(directory, sources, files, sizes, tilesPerSize, sourceIndex, *pool, verbose);
+		}
+
+		if (!writeTileCache(cachePath, sources, sizes, tilesPerSize, sourceIndex) || !mapTileCache(cachePath, cache)) {
+			std::cout << "Nie udało się zapisać biblioteki kafelków, kafelki zostaną użyte bez niej\n";
+			for (int r = 0; r < requested.size(); r++) {
+				tileSet &set = sets[r];
+				set.tiles = tilesPerSize[std::find(sizes.begin(), sizes.end(), requested[r]) - sizes.begin()];
+				set.cache = mapping; // kafelki rozmiarów skopiowanych z pamięci podręcznej wskazują na stare mapowanie
+				for (int i = 0; i < set.tiles.size(); i++) {
+					set.avgColors.push_back(cv::mean(set.tiles[i]));
+					set.sourcePaths.push_back(std::string(directory) + "/" + sources[sourceIndex[i]].name);
+				}
+			}
+			return;
+		}
+		mapping = sharedTileCache(cache); // stare mapowanie zwalniane jest tutaj - kafelki jego rozmiarów są już w nowym pliku
+	}
+
+	for (int i = 0; i < requested.size(); i++) {
+		fillTileSet(sets[i], cache, mapping, tileCacheSizeIndex(cache, requested[i]), directory);
+	}
+}
+
+// Wczytuje do set kafelki jednego rozmiaru - jak getTiles() dla wielu rozmiarów.
+
+inline void getTiles(tileSet &set, cv::Size tileSize, const char* directory, ThreadPool *pool = NULL, bool verbose = true) {
+	std::vector<tileSet> sets;
+	getTiles(sets, std::vector<cv::Size>(1, tileSize), directory, pool, verbose);
+	set = sets[0];
+}
+
+// Biblioteka kafelków wczytywana raz na każdy potrzebny rozmiar - przy wielu obrazach o tym samym rozmiarze kafelków
+// pliki są wczytywane (lub mapowane z pamięci podręcznej) tylko przy pierwszym obrazie. Pliki dekodowane są na wątkach
+// puli pool (NULL - na wszystkich rdzeniach); get() nie może być wtedy wołane z zadań tej puli.
+
+class tileLibrary {
+public:
+	explicit tileLibrary(const std::string &directory, ThreadPool *pool = NULL) : directory(directory), pool(pool), verbose(true) {}
+
+	// Czy wypisywać postęp budowania biblioteki (getTiles) - wyłączane w trybie serwera, gdzie kafelki wczytują wątki zadań.
+
+	void setVerbose(bool value) {
+		std::lock_guard<std::mutex> lock(mutex);
+		verbose = value;
+	}
+
+	tileSet &get(cv::Size tileSize) {
+		return *get(std::vector<cv::Size>(1, tileSize))[0];
+	}
+
+	// Kafelki kilku rozmiarów naraz (np. wszystkich poziomów mozaiki quadtree.h) - rozmiary, których biblioteka jeszcze nie ma,
+	// wczytywane są razem, jednym przejściem po plikach źródłowych.
+
+	std::vector<tileSet *> get(const std::vector<cv::Size> &tileSizes) {
+		std::lock_guard<std::mutex> lock(mutex);
+		std::vector<cv::Size> missing;
+		for (int i = 0; i < tileSizes.size(); i++) {
+			if (sets.count(key(tileSizes[i])) == 0 && std::find(missing.begin(), missing.end(), tileSizes[i]) == missing.end()) {
+				missing.push_back(tileSizes[i]);
+			}
+		}
+
+		if (!missing.empty()) {
+			std::vector<tileSet> loaded;
+			getTiles(loaded, missing, directory.c_str(), pool, verbose);
+			for (int i = 0; i < missing.size(); i++) {
+				sets[key(missing[i])] = loaded[i];
+			}
+		}
+
+		std::vector<tileSet *> result;
+		for (int i = 0; i < tileSizes.size(); i++) {
+			result.push_back(&sets[key(tileSizes[i])]); // elementy std::map nie zmieniają adresu, więc wskaźniki pozostają ważne
+		}
+		return result;
+	}
+
+private:
+	static std::pair<int, int> key(cv::Size tileSize) {
+		return std::make_pair(tileSize.width, tileSize.height);
+	}
+
+	std::string directory;
+	ThreadPool *pool;
+	bool verbose;
+	std::map<std::pair<int, int>, tileSet> sets;
+	std::mutex mutex;
+};
+
+#endif
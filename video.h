@@ -0,0 +1,142 @@
+#ifndef MOZAIKA_VIDEO_H
+#define MOZAIKA_VIDEO_H
+
+#include <cv.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "colorindex.h"
+#include "greedy.h"
+#include "grid.h"
+#include "threadpool.h"
+#include "tilecopy.h"
+#include "tiles.h"
+
+/*
+ * Mozaika sekwencji klatek (program main2, opcja --video): kolejne obrazy traktowane są jak klatki filmu. Sąsiednie klatki
+ * różnią się zwykle tylko w części kadru, więc kafelek dobierany jest od nowa tylko dla pól, których średni kolor zmienił się
+ * o więcej niż próg (scalarDiff) od ostatniego sprawdzenia tego pola. Pozostałe pola zachowują kafelek z poprzedniej klatki,
+ * a mozaika nie jest rysowana od nowa - nadpisywane są tylko pola, w których zmienił się kafelek.
+ *
+ * Żeby kafelki nie migotały, gdy dwa kafelki pasują do pola prawie tak samo dobrze, nowy kafelek zastępuje dotychczasowy tylko
+ * wtedy, gdy jego koszt (różnica pikseli albo średnich kolorów) powiększony o histerezę w procentach jest mniejszy od kosztu
+ * dotychczasowego kafelka dla nowej zawartości pola.
+ */
+
+const int VIDEO_THRESHOLD = 8; // domyślny próg zmiany średniego koloru pola (suma różnic B, G, R)
+const int VIDEO_HYSTERESIS = 10; // domyślna przewaga nowego kafelka w procentach
+
+class frameMosaic {
+public:
+	frameMosaic(tileSet &set, cv::Size tileSize, bool pixelMode, int threshold, int hysteresis, ThreadPool &pool)
+			: set(set), tileSize(tileSize), pixelMode(pixelMode), threshold(threshold), hysteresis(hysteresis), pool(pool),
+			index(set.avgColors), cellMeans(TILES_X * TILES_Y), cellTiles(TILES_X * TILES_Y, -1), cellReflect(TILES_X * TILES_Y, 0),
+			frames(0), totalChanged(0), totalSwitched(0) {
+		if (pixelMode) {
+			matcher.reset(new pixelMatcher(set.tiles, pool.size()));
+		}
+		mosaic.create(tileSize.height * TILES_Y, tileSize.width * TILES_X, CV_8UC3);
+	}
+
+	// Zwraca mozaikę kolejnej klatki (nową macierz - poprzednie wyniki mogą jeszcze czekać na zapis).
+
+	cv::Mat next(const cv::Mat &frame) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		cv::Mat target;
+		cv::resize(frame, target, mosaic.size());
+
+		std::vector<int> changed; // pola, dla których kafelek jest wybierany ponownie
+		std::vector<cv::Scalar> means(TILES_X * TILES_Y);
+		pool.parallelFor(TILES_X * TILES_Y, [&](int i, int) {
+			means[i] = cv::mean(target(cellRect(i)));
+		});
+		for (int i = 0; i < TILES_X * TILES_Y; i++) {
+			if (cellTiles[i] < 0 || scalarDiff(means[i], cellMeans[i]) > threshold) {
+				changed.push_back(i);
+				cellMeans[i] = means[i]; // kolejne zmiany liczone są od stanu z tego sprawdzenia
+			}
+		}
+
+		std::atomic<int> switched(0);
+		copyTileFunction copyTile = copyTileFor(tileSize.width);
+		pool.parallelFor(changed.size(), [&](int j, int worker) {
+			int i = changed[j];
+			cv::Mat cell = target(cellRect(i));
+
+			int tile;
+			bool reflect = false;
+			unsigned long long cost, currentCost = 0;
+			if (pixelMode) {
+				long long computed = 0;
+				tile = matcher->match(cell, worker, reflect, cost, computed);
+				if (cellTiles[i] >= 0) {
+					currentCost = matcher->sadOf(cell, cellTiles[i], cellReflect[i]);
+				}
+			} else {
+				tile = index.nearest(means[i]);
+				cost = scalarDiff(means[i], set.avgColors[tile]);
+				if (cellTiles[i] >= 0) {
+					currentCost = scalarDiff(means[i], set.avgColors[cellTiles[i]]);
+				}
+			}
+
+			if (tile == cellTiles[i] && reflect == (bool)cellReflect[i]) {
+				return;
+			}
+			if (cellTiles[i] >= 0 && cost * (100 + hysteresis) >= currentCost * 100) {
+				return; // nowy kafelek nie jest wyraźnie lepszy
+			}
+
+			cellTiles[i] = tile;
+			cellReflect[i] = reflect;
+			cv::Mat place = mosaic(cellRect(i));
+			copyTile(set.tiles[tile], place, reflect);
+			switched++;
+		});
+
+		frames++;
+		totalChanged += changed.size();
+		totalSwitched += switched;
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "Klatka " << frames << ": sprawdzone pola " << changed.size() << "/" << TILES_X * TILES_Y
+				<< ", zmienione kafelki " << switched << ", " << ms << " ms\n";
+
+		return mosaic.clone();
+	}
+
+	// Podsumowanie całej sekwencji: średnio sprawdzonych pól i zmienionych kafelków na klatkę.
+
+	void printSummary() const {
+		if (frames == 0) {
+			return;
+		}
+		std::cout << "Klatek: " << frames << ", średnio sprawdzonych pól na klatkę: " << (double)totalChanged / frames
+				<< ", zmienionych kafelków: " << (double)totalSwitched / frames << "\n";
+	}
+
+private:
+	cv::Rect cellRect(int i) const {
+		return cv::Rect((i % TILES_X) * tileSize.width, (i / TILES_X) * tileSize.height, tileSize.width, tileSize.height);
+	}
+
+	tileSet &set;
+	cv::Size tileSize;
+	bool pixelMode;
+	int threshold, hysteresis;
+	ThreadPool &pool;
+
+	colorIndex index;
+	std::unique_ptr<pixelMatcher> matcher; // tylko w trybie piksel po pikselu
+	cv::Mat mosaic; // mozaika poprzedniej klatki, uzupełniana o zmienione pola
+	std::vector<cv::Scalar> cellMeans; // średni kolor pola przy ostatnim sprawdzeniu
+	std::vector<int> cellTiles; // bieżący kafelek pola, -1 przed pierwszą klatką
+	std::vector<char> cellReflect;
+	int frames;
+	long long totalChanged, totalSwitched;
+};
+
+#endif